@@ -0,0 +1,514 @@
+#include "flag.h"
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+// Counts every global allocation so benchmarks can report allocations per operation.
+static std::atomic<std::size_t> allocations{0};
+
+// Every replaceable form is defined, so that each allocation is counted and each is released
+// by a matching operator delete. The release goes through an out-of-line helper so the compiler
+// does not pair an inlined std::free against the operator new of the caller.
+static FLAGCXX_NOINLINE void countedFree(void *p) noexcept { std::free(p); }
+
+static void *countedMalloc(std::size_t size) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new(std::size_t size) {
+    if (auto p = countedMalloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    if (auto p = countedMalloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return countedMalloc(size); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return countedMalloc(size); }
+
+void operator delete(void *p) noexcept { countedFree(p); }
+void operator delete[](void *p) noexcept { countedFree(p); }
+void operator delete(void *p, std::size_t) noexcept { countedFree(p); }
+void operator delete[](void *p, std::size_t) noexcept { countedFree(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { countedFree(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { countedFree(p); }
+
+namespace {
+    using ArgsT = std::vector<const char *>;
+
+    // Measures allocations made while the benchmark loop runs and reports them per iteration.
+    class AllocationCounter {
+    public:
+        explicit AllocationCounter(benchmark::State &state) : state(state), start(allocations.load()) {}
+        ~AllocationCounter() {
+            state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(allocations.load() - start),
+                                                             benchmark::Counter::kAvgIterations);
+        }
+
+    private:
+        benchmark::State &state;
+        std::size_t start;
+    };
+
+    std::vector<std::string> flagNames(std::size_t count) {
+        std::vector<std::string> names;
+        names.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            names.push_back("flag" + std::to_string(i));
+        }
+        return names;
+    }
+
+    void parse(benchmark::State &state, flag::FlagSet &flags, ArgsT &args) {
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        if (error) {
+            state.SkipWithError(error->What().c_str());
+        }
+    }
+}// namespace
+
+static void BM_Register(benchmark::State &state) {
+    auto names = flagNames(static_cast<std::size_t>(state.range(0)));
+    std::vector<int> values(names.size());
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        flag::FlagSet flags;
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            flags.Var(values[i], names[i], "A benchmark flag");
+        }
+        benchmark::DoNotOptimize(flags);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Register)->Arg(10)->Arg(100)->Arg(1000);
+
+#if FLAGCXX_HAS_PMR
+// Registers flags in a FlagSet that allocates from an arena, released in one step per iteration.
+static void BM_RegisterArena(benchmark::State &state) {
+    auto names = flagNames(static_cast<std::size_t>(state.range(0)));
+    std::vector<int> values(names.size());
+    std::vector<std::byte> buffer(1 << 20);
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+        flag::FlagSet flags(&arena);
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            flags.Var(values[i], names[i], "A benchmark flag");
+        }
+        benchmark::DoNotOptimize(flags);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RegisterArena)->Arg(10)->Arg(100)->Arg(1000);
+#endif
+
+// Parses every registered flag once, which measures lookups in a FlagSet of that size.
+static void BM_Lookup(benchmark::State &state) {
+    auto names = flagNames(static_cast<std::size_t>(state.range(0)));
+    std::vector<int> values(names.size());
+    flag::FlagSet flags;
+    std::vector<std::string> storage;
+    storage.reserve(names.size());
+    ArgsT args{"program"};
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        flags.Var(values[i], names[i], "A benchmark flag");
+        storage.push_back("--" + names[i] + "=1");
+        args.push_back(storage.back().c_str());
+    }
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        parse(state, flags, args);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Lookup)->Arg(10)->Arg(100)->Arg(1000);
+
+template<typename T>
+static void parseValue(benchmark::State &state, const char *value) {
+    T var{};
+    flag::FlagSet flags;
+    flags.Var(var, "value", "A benchmark flag");
+    auto arg = std::string("--value=") + value;
+    ArgsT args{"program", arg.c_str()};
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        parse(state, flags, args);
+        benchmark::DoNotOptimize(var);
+    }
+}
+static void BM_ParseBool(benchmark::State &state) { parseValue<bool>(state, "true"); }
+static void BM_ParseInt(benchmark::State &state) { parseValue<int>(state, "123456"); }
+static void BM_ParseFloat(benchmark::State &state) { parseValue<float>(state, "3.14159"); }
+static void BM_ParseDouble(benchmark::State &state) { parseValue<double>(state, "2.718281828459045"); }
+static void BM_ParseString(benchmark::State &state) { parseValue<std::string>(state, "a-short-string"); }
+BENCHMARK(BM_ParseBool);
+BENCHMARK(BM_ParseInt);
+BENCHMARK(BM_ParseFloat);
+BENCHMARK(BM_ParseDouble);
+BENCHMARK(BM_ParseString);
+
+static void BM_ParseForm(benchmark::State &state, bool separate) {
+    auto names = flagNames(16);
+    std::vector<int> values(names.size());
+    flag::FlagSet flags;
+    std::vector<std::string> storage;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        flags.Var(values[i], names[i], "A benchmark flag");
+        if (separate) {
+            storage.push_back("--" + names[i]);
+            storage.push_back(std::to_string(i));
+        } else {
+            storage.push_back("--" + names[i] + "=" + std::to_string(i));
+        }
+    }
+    ArgsT args{"program"};
+    for (const auto &arg : storage) {
+        args.push_back(arg.c_str());
+    }
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        parse(state, flags, args);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(names.size()));
+}
+BENCHMARK_CAPTURE(BM_ParseForm, equals, false);
+BENCHMARK_CAPTURE(BM_ParseForm, separate, true);
+
+static void BM_PositionalTail(benchmark::State &state) {
+    std::vector<std::string> storage;
+    for (std::int64_t i = 0; i < state.range(0); ++i) {
+        storage.push_back("/some/input/path/file" + std::to_string(i) + ".txt");
+    }
+    ArgsT args{"program"};
+    for (const auto &arg : storage) {
+        args.push_back(arg.c_str());
+    }
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        flag::FlagSet flags;
+        parse(state, flags, args);
+        benchmark::DoNotOptimize(flags.ArgsView().data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PositionalTail)->Arg(100)->Arg(10000);
+
+static void BM_ParseError(benchmark::State &state, const char *arg) {
+    int value{};
+    flag::FlagSet flags;
+    flags.Var(value, "value", "A benchmark flag");
+    ArgsT args{"program", arg};
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        benchmark::DoNotOptimize(error);
+    }
+}
+BENCHMARK_CAPTURE(BM_ParseError, undefined, "--undefined=1");
+BENCHMARK_CAPTURE(BM_ParseError, bad_value, "--value=abc");
+
+static void BM_ParseErrorWhat(benchmark::State &state) {
+    int value{};
+    flag::FlagSet flags;
+    flags.Var(value, "value", "A benchmark flag");
+    ArgsT args{"program", "--value=abc"};
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        benchmark::DoNotOptimize(error->What().data());
+    }
+}
+BENCHMARK(BM_ParseErrorWhat);
+
+// Parses a misspelled flag among many, which searches the name index for a suggestion, or a
+// prefix of one, which the index resolves.
+static void BM_Misspelled(benchmark::State &state, bool prefix) {
+    auto names = flagNames(static_cast<std::size_t>(state.range(0)));
+    std::vector<int> values(names.size());
+    flag::FlagSet flags;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        flags.Var(values[i], names[i], "A benchmark flag");
+    }
+    flags.AllowPrefixes(prefix);
+    auto arg = prefix ? "--" + names.back().substr(0, names.back().size() - 1) + "=1" : "--flga123=1";
+    ArgsT args{"program", arg.c_str()};
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        benchmark::DoNotOptimize(error);
+    }
+}
+BENCHMARK_CAPTURE(BM_Misspelled, suggestion, false)->Arg(1000)->Arg(10000);
+BENCHMARK_CAPTURE(BM_Misspelled, prefix, true)->Arg(1000)->Arg(10000);
+
+// Parses arguments held as std::strings, either directly as a range or by first building the
+// NUL-terminated argv that Parse(argc, argv) needs.
+static void BM_ParseRange(benchmark::State &state, bool copy) {
+    std::vector<int> values(8);
+    flag::FlagSet flags;
+    auto names = flagNames(values.size());
+    std::vector<std::string> args;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        flags.Var(values[i], names[i], "A benchmark flag");
+        args.push_back("--" + names[i] + "=" + std::to_string(i));
+    }
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        std::optional<flag::Error> error;
+        if (copy) {
+            std::vector<std::string> strings(args.begin(), args.end());
+            ArgsT argv{"program"};
+            for (auto &arg: strings) {
+                argv.push_back(arg.c_str());
+            }
+            error = flags.Parse(static_cast<int>(argv.size()), argv.data());
+        } else {
+            error = flags.Parse(args);
+        }
+        benchmark::DoNotOptimize(error);
+    }
+}
+BENCHMARK_CAPTURE(BM_ParseRange, range, false);
+BENCHMARK_CAPTURE(BM_ParseRange, argv_copy, true);
+
+// A CLI with 80 subcommands of 10 flags each, built and parsed once per iteration: lazily,
+// populating only the chosen subcommand, or eagerly, populating every subcommand's FlagSet.
+static void BM_Subcommands(benchmark::State &state, bool eager) {
+    auto commands = flagNames(80);
+    auto names = flagNames(10);
+    std::vector<int> values(names.size());
+    ArgsT args{"program", "flag42", "--flag3=1"};
+    auto populate = [&](flag::FlagSet &child) {
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            child.Var(values[i], names[i], "A benchmark flag");
+        }
+    };
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        if (eager) {
+            std::vector<flag::FlagSet> children(commands.size());
+            for (auto &child: children) {
+                populate(child);
+            }
+            auto &child = children[42];
+            auto error = child.Parse(static_cast<int>(args.size() - 1), args.data() + 1);
+            benchmark::DoNotOptimize(error);
+        } else {
+            flag::FlagSet flags;
+            for (auto &command: commands) {
+                flags.Subcommand(command, "A benchmark command", [&populate](flag::FlagSet &child) { populate(child); });
+            }
+            auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+            benchmark::DoNotOptimize(error);
+        }
+    }
+}
+BENCHMARK_CAPTURE(BM_Subcommands, lazy, false);
+BENCHMARK_CAPTURE(BM_Subcommands, eager, true);
+
+// Parses eight flags with no observer, which compiles the hooks out, and with the built-in
+// per-flag counters, which also time each conversion.
+static void BM_ParseObserved(benchmark::State &state, bool observed) {
+    std::vector<int> values(8);
+    flag::FlagSet flags;
+    auto names = flagNames(values.size());
+    std::vector<std::string> args;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        flags.Var(values[i], names[i], "A benchmark flag");
+        args.push_back("--" + names[i] + "=" + std::to_string(i));
+    }
+    flag::Counters counters{flags};
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        auto error = observed ? flags.Parse(args, counters) : flags.Parse(args);
+        benchmark::DoNotOptimize(error);
+    }
+}
+BENCHMARK_CAPTURE(BM_ParseObserved, none, false);
+BENCHMARK_CAPTURE(BM_ParseObserved, counters, true);
+
+// Parses eight range-checked int flags and one enum flag, with the checks fused into the
+// setters, and as plain ints and a string validated in a second pass as callers did before.
+enum class BenchMode { Fast, Safe };
+static constexpr auto benchModes = flag::MakeEnum<BenchMode>({{"fast", BenchMode::Fast}, {"safe", BenchMode::Safe}});
+
+static void BM_ParseConstrained(benchmark::State &state, bool fused) {
+    std::vector<int> values(8);
+    BenchMode mode{};
+    std::string modeName{};
+    flag::FlagSet flags;
+    auto names = flagNames(values.size());
+    std::vector<std::string> storage;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        if (fused) {
+            flags.Var(values[i], names[i], "A benchmark flag", flag::Range(1, 256));
+        } else {
+            flags.Var(values[i], names[i], "A benchmark flag");
+        }
+        storage.push_back("--" + names[i] + "=" + std::to_string(i + 1));
+    }
+    if (fused) {
+        flags.Var(mode, "mode", "A mode", benchModes);
+    } else {
+        flags.Var(modeName, "mode", "A mode");
+    }
+    storage.emplace_back("--mode=safe");
+    ArgsT args{"program"};
+    for (const auto &arg : storage) {
+        args.push_back(arg.c_str());
+    }
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        parse(state, flags, args);
+        if (!fused) {
+            for (auto value : values) {
+                if (value < 1 || value > 256) {
+                    state.SkipWithError("out of range");
+                }
+            }
+            if (modeName == "fast") {
+                mode = BenchMode::Fast;
+            } else if (modeName == "safe") {
+                mode = BenchMode::Safe;
+            } else {
+                state.SkipWithError("bad mode");
+            }
+        }
+        benchmark::DoNotOptimize(mode);
+    }
+}
+BENCHMARK_CAPTURE(BM_ParseConstrained, fused, true);
+BENCHMARK_CAPTURE(BM_ParseConstrained, second_pass, false);
+
+// Reads a Live value the way a request thread would, between quiescent states.
+static void BM_LiveRead(benchmark::State &state) {
+    flag::Live<int> value{42};
+    flag::LiveReader reader;
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(*value);
+    }
+    reader.Quiescent();
+}
+BENCHMARK(BM_LiveRead);
+
+// Reload of one Live flag from a command line, including reclamation of the old snapshot.
+static void BM_Reload(benchmark::State &state) {
+    flag::Live<int> value{0};
+    flag::FlagSet flags;
+    flags.Var(value, "value", "A benchmark flag");
+    ArgsT args{"program", "--value=7"};
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        auto error = flags.Reload([&](flag::FlagSet &f) { return f.Parse(static_cast<int>(args.size()), args.data()); });
+        benchmark::DoNotOptimize(error);
+    }
+}
+BENCHMARK(BM_Reload);
+
+// Reads a generated config file that sets each of 100 flags many times. Each iteration maps the
+// file into a fresh FlagSet, which keeps its files mapped.
+static void BM_ParseFile(benchmark::State &state) {
+    auto names = flagNames(100);
+    std::vector<int> values(names.size());
+    auto path = (std::filesystem::temp_directory_path() / "flagcxx_bench.ini").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        for (std::int64_t line = 0; line < state.range(0); ++line) {
+            file << names[static_cast<std::size_t>(line) % names.size()] << " = " << line << '\n';
+        }
+    }
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        flag::FlagSet flags;
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            flags.Var(values[i], names[i], "A benchmark flag");
+        }
+        auto error = flags.ParseFile(path);
+        if (error) {
+            state.SkipWithError(error->What().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    std::filesystem::remove(path);
+}
+BENCHMARK(BM_ParseFile)->Arg(10000)->Arg(100000);
+
+// Restores 100 bound flags, half integers and half strings, by parsing their values from a
+// command line, or by loading a snapshot of them.
+static void BM_Restore(benchmark::State &state, bool snapshot) {
+    auto names = flagNames(100);
+    std::vector<int> numbers(names.size() / 2);
+    std::vector<std::string> strings(names.size() - numbers.size());
+    flag::FlagSet flags;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        if (i % 2 == 0) {
+            flags.Var(numbers[i / 2], names[i], "A benchmark flag");
+        } else {
+            flags.Var(strings[i / 2], names[i], "A benchmark flag");
+        }
+    }
+    std::vector<std::string> args{};
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        args.push_back("-" + names[i] + "=" + (i % 2 == 0 ? std::to_string(i * 1000) : "value-" + names[i]));
+    }
+    ArgsT argv{"bench"};
+    for (const auto &arg: args) {
+        argv.push_back(arg.c_str());
+    }
+    if (flags.Parse(static_cast<int>(argv.size()), argv.data())) {
+        state.SkipWithError("parse failed");
+        return;
+    }
+    auto blob = flags.SaveSnapshot();
+
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        auto error = snapshot ? flags.LoadSnapshot(blob) : flags.Parse(static_cast<int>(argv.size()), argv.data());
+        if (error) {
+            state.SkipWithError(error->What().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(numbers.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(names.size()));
+}
+BENCHMARK_CAPTURE(BM_Restore, text, false);
+BENCHMARK_CAPTURE(BM_Restore, snapshot, true);
+
+// Renders the usage of 1000 flags into a fresh FlagSet's cache, or reads the cached text.
+static void BM_Usage(benchmark::State &state, bool cached) {
+    auto names = flagNames(1000);
+    std::vector<int> values(names.size());
+    flag::FlagSet flags;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        flags.Var(values[i], names[i], "A benchmark flag with a usage string long enough to wrap onto a second line");
+    }
+    AllocationCounter counter{state};
+    for (auto _ : state) {
+        if (!cached) {
+            int extra = 0;
+            flags.Var(extra, names[0], "Invalidates the cache without adding a flag");
+        }
+        benchmark::DoNotOptimize(flags.Usage().data());
+    }
+}
+BENCHMARK_CAPTURE(BM_Usage, render, false);
+BENCHMARK_CAPTURE(BM_Usage, cached, true);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,1091 @@
+#include "flag.h"
+
+// Compiled by the flagcxx library, or included by flag.h when it is header-only. The guard is
+// after the include so that a header-only build of this file defines nothing twice.
+#ifndef FLAGCXX_FLAG_CPP
+#define FLAGCXX_FLAG_CPP
+
+#include <cctype>
+
+#if FLAGCXX_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <cstdio>
+#endif
+
+// FlagSet::PrintUsage writes to a file descriptor with POSIX write, or _write on Windows.
+#if defined(_WIN32)
+#include <io.h>
+#define FLAGCXX_WRITE _write
+#else
+#include <unistd.h>
+#define FLAGCXX_WRITE ::write
+#endif
+
+// FlagSet::ParseEnv reads the process environment from environ.
+#if defined(_WIN32)
+#include <stdlib.h>
+#define FLAGCXX_ENVIRON _environ
+#else
+extern "C" char **environ;
+#define FLAGCXX_ENVIRON environ
+#endif
+
+namespace flag {
+    const std::string &Error::What() const {
+        if (formatted) {
+            return message;
+        }
+        formatted = true;
+        auto name = views.name;
+        auto value = views.value;
+
+        auto append = [this](std::initializer_list<std::string_view> parts) {
+            std::size_t size = 0;
+            for (auto part : parts) {
+                size += part.size();
+            }
+            message.reserve(message.size() + size);
+            for (auto part : parts) {
+                message.append(part.data(), part.size());
+            }
+        };
+        auto why = detail ? detail->What() : std::string_view{};
+        if (line > 0) {
+            std::array<char, 12> lineText{};
+            std::array<char, 12> columnText{};
+            auto lineEnd = std::to_chars(lineText.data(), lineText.data() + lineText.size(), line).ptr;
+            auto columnEnd = std::to_chars(columnText.data(), columnText.data() + columnText.size(), column).ptr;
+            append({file, ":", std::string_view(lineText.data(), static_cast<std::size_t>(lineEnd - lineText.data())),
+                    ":", std::string_view(columnText.data(), static_cast<std::size_t>(columnEnd - columnText.data())), ": "});
+        }
+        switch (type) {
+            case EType::Help:
+                break;
+            case EType::NumArgs:
+                append({"At least 1 argument is needed."});
+                break;
+            case EType::BadSyntax:
+                append({"Bad flag syntax: ", name});
+                break;
+            case EType::UndefinedFlag:
+                append({"Flag provided but not defined: ", name});
+                if (!why.empty()) {
+                    append({", did you mean ", why, "?"});
+                }
+                break;
+            case EType::MissingValue:
+                append({"Flag is missing a value: ", name});
+                break;
+            case EType::BadValue:
+                if (isBool && value.empty()) {
+                    append({"Bad boolean flag ", name, ": ", why});
+                } else if (isBool) {
+                    append({"Bad boolean value ", value, " for flag ", name, ": ", why});
+                } else {
+                    append({"Bad value ", value, " for flag ", name, ": ", why});
+                }
+                break;
+            case EType::BadFile:
+                append({"Cannot read file ", name.empty() ? std::string_view{file} : name, ": ", why});
+                break;
+            case EType::UndefinedCommand:
+                append({"Command provided but not defined: ", name});
+                break;
+            case EType::BadSnapshot:
+                if (name.empty()) {
+                    append({"Bad snapshot: ", why});
+                } else {
+                    append({"Bad snapshot value for flag ", name, ": ", why});
+                }
+                break;
+        }
+        return message;
+    }
+
+    namespace detail {
+        MappedFile::~MappedFile() {
+#if FLAGCXX_HAS_MMAP
+            if (data != nullptr) {
+                ::munmap(const_cast<char *>(data), size);
+            }
+#endif
+        }
+
+        std::optional<FlagError> MappedFile::Open(const char *path) {
+#if FLAGCXX_HAS_MMAP
+            auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return FlagError(std::strerror(errno));
+            }
+            struct stat st {};
+            if (::fstat(fd, &st) != 0) {
+                auto err = errno;
+                ::close(fd);
+                return FlagError(std::strerror(err));
+            }
+            if (st.st_size > 0) {
+                auto mapped = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED) {
+                    auto err = errno;
+                    ::close(fd);
+                    return FlagError(std::strerror(err));
+                }
+                data = static_cast<const char *>(mapped);
+                size = static_cast<std::size_t>(st.st_size);
+            }
+            ::close(fd);
+#else
+            auto file = std::fopen(path, "rb");
+            if (file == nullptr) {
+                return FlagError(std::strerror(errno));
+            }
+            std::fseek(file, 0, SEEK_END);
+            auto length = std::ftell(file);
+            std::fseek(file, 0, SEEK_SET);
+            if (length > 0) {
+                buffer = std::make_unique<char[]>(static_cast<std::size_t>(length));
+                size = std::fread(buffer.get(), 1, static_cast<std::size_t>(length), file);
+                data = buffer.get();
+            }
+            std::fclose(file);
+#endif
+            return {};
+        }
+
+        void FlatFlagTable::Insert(std::string_view name, Flag flag) {
+            auto hash = Hash(name);
+            if (lookup(name, hash) != nullptr) {
+                return;
+            }
+            if ((records.size() + 1) * 2 > index.size()) {
+                grow();
+            }
+            offsets.push_back(static_cast<std::uint32_t>(pool.size()));
+            pool.append(name);
+            records.push_back(std::move(flag));
+            place(hash, static_cast<std::uint32_t>(records.size()));
+        }
+
+        void FlatFlagTable::Reserve(std::size_t count) {
+            while (count * 2 > index.size()) {
+                grow();
+            }
+        }
+
+        void FlatFlagTable::place(std::uint32_t hash, std::uint32_t record) {
+            auto mask = index.size() - 1;
+            auto i = hash & mask;
+            while (index[i].record != 0) {
+                i = (i + 1) & mask;
+            }
+            index[i] = Entry{hash, record};
+        }
+
+        void FlatFlagTable::grow() {
+            auto old = std::move(index);
+            index = Vector<Entry>(old.get_allocator());
+            index.assign(old.empty() ? 16 : old.size() * 2, Entry{0, 0});
+            // The tables grow in step with the index, once per doubling.
+            offsets.reserve(index.size() / 2);
+            records.reserve(index.size() / 2);
+            for (const auto &entry: old) {
+                if (entry.record != 0) {
+                    place(entry.hash, entry.record);
+                }
+            }
+        }
+
+        void NameIndex::Build(Vector<std::string_view> indexed) {
+            names = std::move(indexed);
+            std::sort(names.begin(), names.end());
+            names.erase(std::unique(names.begin(), names.end()), names.end());
+            nodes.clear();
+            depth = 0;
+            if (names.empty()) {
+                return;
+            }
+            nodes.push_back(node(0, static_cast<std::uint32_t>(names.size()), 0));
+            // Breadth first, so that each node's children are added together.
+            for (std::size_t i = 0; i < nodes.size(); ++i) {
+                auto parent = nodes[i];
+                auto lo = parent.lo;
+                if (names[lo].size() == parent.end) {
+                    ++lo;
+                }
+                nodes[i].first = static_cast<std::uint32_t>(nodes.size());
+                while (lo < parent.hi) {
+                    auto c = names[lo][parent.end];
+                    auto hi = lo + 1;
+                    while (hi < parent.hi && names[hi][parent.end] == c) {
+                        ++hi;
+                    }
+                    nodes.push_back(node(lo, hi, parent.end));
+                    lo = hi;
+                }
+                nodes[i].count = static_cast<std::uint32_t>(nodes.size()) - nodes[i].first;
+            }
+        }
+
+        std::string_view NameIndex::UniquePrefix(std::string_view prefix) const {
+            if (nodes.empty()) {
+                return {};
+            }
+            const Node *at = &nodes[0];
+            std::size_t pos = 0;
+            while (true) {
+                auto name = names[at->lo];
+                for (auto k = at->start; k < at->end && pos < prefix.size(); ++k, ++pos) {
+                    if (name[k] != prefix[pos]) {
+                        return {};
+                    }
+                }
+                if (pos == prefix.size()) {
+                    return at->hi - at->lo == 1 ? name : std::string_view{};
+                }
+                const Node *next = nullptr;
+                for (auto i = at->first; i < at->first + at->count; ++i) {
+                    if (names[nodes[i].lo][at->end] == prefix[pos]) {
+                        next = &nodes[i];
+                        break;
+                    }
+                }
+                if (next == nullptr) {
+                    return {};
+                }
+                at = next;
+            }
+        }
+
+        std::string_view NameIndex::Closest(std::string_view query, std::size_t maxDistance) const {
+            if (nodes.empty()) {
+                return {};
+            }
+            // Row k of the Levenshtein table compares query with the first k name characters.
+            // Tables for typical names fit on the stack, so that misspellings do not allocate.
+            auto width = query.size() + 1;
+            std::array<std::uint32_t, 512> local;
+            Vector<std::uint32_t> allocated(nodes.get_allocator());
+            auto rows = local.data();
+            if ((depth + 1) * width > local.size()) {
+                allocated.resize((depth + 1) * width);
+                rows = allocated.data();
+            }
+            for (std::size_t j = 0; j < width; ++j) {
+                rows[j] = static_cast<std::uint32_t>(j);
+            }
+            Search search{query, rows, width, static_cast<std::uint32_t>(maxDistance + 1), {}};
+            visit(nodes[0], search);
+            return search.best;
+        }
+
+        NameIndex::Node NameIndex::node(std::uint32_t lo, std::uint32_t hi, std::uint32_t start) {
+            // The names are sorted, so those in the range share the prefix of the first and last.
+            auto first = names[lo];
+            auto last = names[hi - 1];
+            std::size_t end = start;
+            while (end < first.size() && end < last.size() && first[end] == last[end]) {
+                ++end;
+            }
+            depth = std::max(depth, end);
+            return Node{lo, hi, start, static_cast<std::uint32_t>(end)};
+        }
+
+        void NameIndex::visit(const Node &at, Search &search) const {
+            auto name = names[at.lo];
+            for (auto k = at.start; k < at.end; ++k) {
+                auto above = search.rows + k * search.width;
+                auto row = above + search.width;
+                row[0] = k + 1;
+                auto smallest = row[0];
+                for (std::size_t j = 1; j < search.width; ++j) {
+                    auto substitute = above[j - 1] + (search.query[j - 1] == name[k] ? 0u : 1u);
+                    row[j] = std::min({above[j] + 1, row[j - 1] + 1, substitute});
+                    smallest = std::min(smallest, row[j]);
+                }
+                if (smallest >= search.bound) {
+                    return;
+                }
+            }
+            if (name.size() == at.end) {
+                auto distance = search.rows[at.end * search.width + search.width - 1];
+                if (distance < search.bound) {
+                    search.bound = distance;
+                    search.best = name;
+                }
+            }
+            for (auto i = at.first; i < at.first + at.count; ++i) {
+                visit(nodes[i], search);
+            }
+        }
+    }// namespace detail
+
+    FlagSet::FlagSet(detail::SchemaView view, detail::Allocator allocator)
+        : positional(allocator), flags(allocator), schema(view), slots(allocator), files(allocator),
+          commands(allocator), child(nullptr, ChildDeleter{allocator}),
+          usageCache{detail::String(allocator), detail::String(allocator)}, nameTree(allocator) {
+        slots.reserve(view.size);
+        for (std::size_t i = 0; i < view.size; ++i) {
+            slots.emplace_back(Flag::SetFn{}, view.specs[i].usage, view.specs[i].type == Type::Bool);
+            slots.back().id = static_cast<std::uint32_t>(i);
+        }
+    }
+
+    const std::vector<std::string> &FlagSet::Args() const {
+        if (args.size() != positional.size()) {
+            args.reserve(positional.size());
+            args.insert(args.end(), positional.begin() + static_cast<std::ptrdiff_t>(args.size()), positional.end());
+        }
+        return args;
+    }
+
+    void FlagSet::add(std::string_view name, Flag flag) {
+        for (auto &cached: usageCache) {
+            cached.clear();
+        }
+        nameTreeBuilt = false;
+        if (auto index = schema.Find(name)) {
+            flag.id = static_cast<std::uint32_t>(*index);
+            slots[*index] = std::move(flag);
+            return;
+        }
+#if FLAGCXX_FLAT_STORAGE
+        flag.id = static_cast<std::uint32_t>(slots.size() + flags.Size());
+        flags.Insert(name, std::move(flag));
+#else
+        flag.id = static_cast<std::uint32_t>(slots.size() + flags.size());
+        flags.insert({name, std::move(flag)});
+#endif
+    }
+
+    void FlagSet::reserve(std::size_t count) {
+#if FLAGCXX_FLAT_STORAGE
+        flags.Reserve(count);
+#else
+        flags.reserve(count);
+#endif
+    }
+
+    Flag *FlagSet::find(std::string_view name) {
+        if (auto index = schema.Find(name)) {
+            return &slots[*index];
+        }
+#if FLAGCXX_FLAT_STORAGE
+        return flags.Find(name);
+#else
+        auto flag = flags.find(name);
+        if (flag == flags.end()) {
+            return nullptr;
+        }
+        return &flag->second;
+#endif
+    }
+
+    std::optional<Error> FlagSet::ParseEnv(std::string_view prefix) { return ParseEnv(prefix, FLAGCXX_ENVIRON); }
+
+    std::optional<Error> FlagSet::ParseEnv(std::string_view prefix, const char *const *env) {
+        std::string name{};
+        for (; env != nullptr && *env != nullptr; ++env) {
+            std::string_view entry{*env};
+            auto equals = entry.find('=');
+            if (equals == std::string_view::npos || equals <= prefix.size()) {
+                continue;
+            }
+            auto key = entry.substr(0, equals);
+            if (key.substr(0, prefix.size()) != prefix || (!prefix.empty() && key[prefix.size()] != '_')) {
+                continue;
+            }
+
+            // Names are lower case, and may use either underscores or dashes between words.
+            auto upper = key.substr(prefix.empty() ? 0 : prefix.size() + 1);
+            name.assign(upper);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+                return static_cast<char>(std::tolower(c));
+            });
+            auto flag = find(name);
+            if (flag == nullptr && name.find('_') != std::string::npos) {
+                std::replace(name.begin(), name.end(), '_', '-');
+                flag = find(name);
+            }
+            if (flag == nullptr) {
+                continue;
+            }
+            auto value = entry.substr(equals + 1);
+            if (auto err = setFrom(*flag, Source::Environment, value)) {
+                return Error(Error::EType::BadValue, -1, key, value, std::move(err), flag->isBool);
+            }
+        }
+        return {};
+    }
+
+    std::optional<Error> FlagSet::ParseFile(const std::string &path) {
+        detail::MappedFile file;
+        if (auto err = file.Open(path.c_str())) {
+            return Error(Error::EType::BadFile, -1, {}, {}, std::move(err)).At(path);
+        }
+        files.push_back(std::move(file));
+        auto content = files.back().View();
+
+        detail::String scoped(allocator());
+        std::string_view section{};
+        int line = 0;
+        std::size_t next = 0;
+        while (next < content.size()) {
+            ++line;
+            auto begin = next;
+            // find() is a memchr over the mapping, lines are never copied.
+            auto end = content.find('\n', begin);
+            end = end == std::string_view::npos ? content.size() : end;
+            next = end + 1;
+            auto column = [&](std::string_view part) {
+                return static_cast<int>(part.data() - content.data() - static_cast<std::ptrdiff_t>(begin)) + 1;
+            };
+
+            auto text = detail::Trim(content.substr(begin, end - begin));
+            if (text.empty() || text[0] == '#' || text[0] == ';') {
+                continue;
+            }
+            if (text[0] == '[') {
+                if (text.back() != ']') {
+                    return Error(Error::EType::BadSyntax, -1, text).At(path, line, column(text));
+                }
+                section = detail::Trim(text.substr(1, text.size() - 2));
+                continue;
+            }
+
+            auto equals = text.find('=');
+            auto key = detail::Trim(text.substr(0, equals));
+            if (key.empty()) {
+                return Error(Error::EType::BadSyntax, -1, text).At(path, line, column(text));
+            }
+            auto name = key;
+            if (!section.empty()) {
+                scoped.assign(section).append(1, '.').append(key);
+                name = scoped;
+            }
+            auto flag = find(name);
+            if (flag == nullptr) {
+                return suggest(Error(Error::EType::UndefinedFlag, -1, key).At(path, line, column(key)));
+            }
+
+            std::string_view value{};
+            auto at = column(key);
+            if (equals != std::string_view::npos) {
+                value = detail::Trim(text.substr(equals + 1));
+                at = column(value);
+                if (value.size() >= 2 && (value[0] == '"' || value[0] == '\'') && value.back() == value[0]) {
+                    value = value.substr(1, value.size() - 2);
+                }
+            } else if (!flag->isBool) {
+                return Error(Error::EType::MissingValue, -1, key).At(path, line, at);
+            }
+            if (auto err = setFrom(*flag, Source::File, value)) {
+                return Error(Error::EType::BadValue, -1, key, value, std::move(err), flag->isBool).At(path, line, at);
+            }
+        }
+        return {};
+    }
+
+    std::optional<FlagError> FlagSet::setFrom(Flag &flag, Source source, std::string_view value) {
+        if (flag.source > source) {
+            return {};
+        }
+        detail::Supersede(flag, source);
+        if (flag.setFn) {
+            if (auto err = flag.setFn(flag.isBool && value.empty() ? std::string_view{"true"} : value)) {
+                return err;
+            }
+        }
+        flag.source = source;
+        return {};
+    }
+
+    std::optional<Source> FlagSet::SourceOf(std::string_view name) const {
+        if (auto flag = const_cast<FlagSet *>(this)->find(name)) {
+            return flag->source;
+        }
+        return {};
+    }
+
+    Counters::Counters(FlagSet &flags) : owner(&flags) {
+        flags.forEach([this](std::string_view name, const Flag &flag) {
+            if (flag.id >= names.size()) {
+                names.resize(flag.id + 1);
+            }
+            names[flag.id] = name;
+        });
+        hits = std::make_unique<std::atomic<std::uint64_t>[]>(names.size());
+    }
+
+    std::string Counters::Table() const {
+        std::string table{};
+        std::array<char, 24> count{};
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            auto end = std::to_chars(count.data(), count.data() + count.size(), hits[i].load(std::memory_order_relaxed)).ptr;
+            table.append(names[i]).append(1, '\t').append(count.data(), static_cast<std::size_t>(end - count.data())).append(1, '\n');
+        }
+        return table;
+    }
+
+    void IncrementalParser::append(std::string_view bytes) {
+        if (!buffering) {
+            buffering = true;
+            partial = blocks.empty() ? nullptr : blocks.back().get() + used;
+        }
+        if (blocks.empty() || used + bytes.size() > capacity) {
+            auto partialSize = blocks.empty() ? 0 : static_cast<std::size_t>(blocks.back().get() + used - partial);
+            auto size = std::max(minBlock, 2 * (partialSize + bytes.size()));
+            auto block = std::make_unique<char[]>(size);
+            if (partialSize > 0) {
+                std::memcpy(block.get(), partial, partialSize);
+            }
+            partial = block.get();
+            used = partialSize;
+            capacity = size;
+            blocks.push_back(std::move(block));
+        }
+        if (!bytes.empty()) {
+            std::memcpy(blocks.back().get() + used, bytes.data(), bytes.size());
+            used += bytes.size();
+        }
+    }
+
+    std::optional<Error> IncrementalParser::complete() {
+        buffering = false;
+        auto token = std::string_view(partial, static_cast<std::size_t>(blocks.back().get() + used - partial));
+        auto at = index++;
+        if (!inFlags) {
+            positional.push_back(token);
+            return {};
+        }
+        if (auto error = parser.Feed(Classify(token, at))) {
+            failed = error;
+            return error;
+        }
+        if (parser.Current() != detail::TokenParser<Find>::State::Flags) {
+            inFlags = false;
+            if (parser.Current() == detail::TokenParser<Find>::State::Positional) {
+                positional.push_back(token);
+            }
+        }
+        return {};
+    }
+
+    std::optional<Error> IncrementalParser::FeedBytes(std::string_view bytes) {
+        while (!failed && !bytes.empty()) {
+            auto end = bytes.find(separator);
+            append(bytes.substr(0, end));
+            if (end == std::string_view::npos) {
+                break;
+            }
+            bytes.remove_prefix(end + 1);
+            if (auto error = complete()) {
+                return error;
+            }
+        }
+        return failed;
+    }
+
+    std::optional<Error> IncrementalParser::Finish() {
+        if (!failed && buffering) {
+            if (auto error = complete()) {
+                return error;
+            }
+        }
+        if (!failed && inFlags) {
+            failed = parser.Finish();
+        }
+        return failed;
+    }
+
+    std::optional<Error> FlagSet::Parse(int argc, const char **argv) {
+        NullObserver observer;
+        return Parse(argc, argv, observer);
+    }
+
+    const detail::NameIndex &FlagSet::nameIndex() {
+        if (!nameTreeBuilt) {
+            detail::Vector<std::string_view> all(allocator());
+            forEach([&all](std::string_view name, Flag &) { all.push_back(name); });
+            nameTree.Build(std::move(all));
+            nameTreeBuilt = true;
+        }
+        return nameTree;
+    }
+
+    std::string_view FlagSet::Suggest(std::string_view name) {
+        return nameIndex().Closest(name, name.size() <= 3 ? 1 : 2);
+    }
+
+    Error FlagSet::suggest(Error error) {
+        if (error.Type() != Error::EType::UndefinedFlag) {
+            return error;
+        }
+        auto suggestion = Suggest(error.Name());
+        return suggestion.empty() ? std::move(error) : std::move(error).Suggest(suggestion);
+    }
+
+    void FlagSet::ChildDeleter::operator()(FlagSet *child) const {
+        detail::Rebind<FlagSet> childAllocator(allocator);
+        child->~FlagSet();
+        std::allocator_traits<detail::Rebind<FlagSet>>::deallocate(childAllocator, child, 1);
+    }
+
+    std::optional<Error> FlagSet::Validate() {
+        std::optional<Error> error{};
+        forEach([&error](std::string_view name, const Flag &flag) {
+            std::string_view raw{};
+            if (!error && flag.resolveFn) {
+                if (auto err = flag.resolveFn(raw)) {
+                    error = Error(Error::EType::BadValue, -1, name, raw, std::move(err), flag.isBool);
+                }
+            }
+        });
+        return error;
+    }
+
+    namespace detail {
+        // A snapshot starts with a header, followed by one entry per flag in registration
+        // order: the entry's size, the flag's source, and its value.
+        constexpr std::uint32_t snapshotMagic = 0x53474c46;// "FLGS" read in little-endian order.
+        constexpr std::uint32_t snapshotVersion = 1;
+    }// namespace detail
+
+    std::uint64_t FlagSet::snapshotLayout(detail::Vector<std::pair<std::string_view, Flag *>> &ordered) {
+#if FLAGCXX_FLAT_STORAGE
+        ordered.resize(slots.size() + flags.Size());
+#else
+        ordered.resize(slots.size() + flags.size());
+#endif
+        // Slots are visited first, in order, and unbound ones have no id of their own.
+        std::size_t index = 0;
+        forEach([&](std::string_view name, Flag &flag) {
+            ordered[index < slots.size() ? index : flag.id] = {name, &flag};
+            ++index;
+        });
+
+        // FNV-1a over every name and snapshot type.
+        std::uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](unsigned char c) { hash = (hash ^ c) * 1099511628211ull; };
+        for (const auto &[name, flag]: ordered) {
+            for (auto c: name) {
+                mix(static_cast<unsigned char>(c));
+            }
+            mix(0);
+            for (int shift = 0; shift < 32; shift += 8) {
+                mix(static_cast<unsigned char>(flag->snapshotType >> shift));
+            }
+        }
+        return hash;
+    }
+
+    std::string FlagSet::SaveSnapshot() {
+        detail::Vector<std::pair<std::string_view, Flag *>> ordered(allocator());
+        auto layout = snapshotLayout(ordered);
+
+        std::string out{};
+        detail::AppendBytes(out, detail::snapshotMagic);
+        detail::AppendBytes(out, detail::snapshotVersion);
+        detail::AppendBytes(out, layout);
+        detail::AppendBytes(out, static_cast<std::uint32_t>(ordered.size()));
+        for (const auto &[name, flag]: ordered) {
+            auto start = out.size();
+            detail::AppendBytes(out, std::uint32_t{0});
+            out.push_back(static_cast<char>(flag->source));
+            if (flag->snapshotFn) {
+                flag->snapshotFn(&out, nullptr);
+            }
+            auto size = static_cast<std::uint32_t>(out.size() - start - sizeof(std::uint32_t));
+            std::memcpy(out.data() + start, &size, sizeof(size));
+        }
+        return out;
+    }
+
+    std::optional<Error> FlagSet::LoadSnapshot(std::string_view snapshot) {
+        auto bad = [](std::string_view name, FlagError why) {
+            return Error(Error::EType::BadSnapshot, -1, name, {}, std::move(why));
+        };
+        detail::Vector<std::pair<std::string_view, Flag *>> ordered(allocator());
+        auto layout = snapshotLayout(ordered);
+
+        std::uint32_t magic{}, version{}, count{};
+        std::uint64_t saved{};
+        if (!detail::ReadBytes(snapshot, magic) || magic != detail::snapshotMagic) {
+            return bad({}, FlagError::Static("not a flag snapshot"));
+        }
+        if (!detail::ReadBytes(snapshot, version) || version != detail::snapshotVersion) {
+            return bad({}, FlagError::Static("unsupported version"));
+        }
+        if (!detail::ReadBytes(snapshot, saved) || !detail::ReadBytes(snapshot, count)) {
+            return bad({}, FlagError::Static("truncated"));
+        }
+        if (saved != layout || count != ordered.size()) {
+            return bad({}, FlagError::Static("saved from different flags"));
+        }
+
+        // Check the framing before applying anything.
+        auto entries = snapshot;
+        for (std::size_t i = 0; i < ordered.size(); ++i) {
+            std::uint32_t size{};
+            if (!detail::ReadBytes(entries, size) || size < 1 || entries.size() < size) {
+                return bad({}, FlagError::Static("truncated"));
+            }
+            entries.remove_prefix(size);
+        }
+        if (!entries.empty()) {
+            return bad({}, FlagError::Static("trailing bytes"));
+        }
+
+        for (const auto &[name, flag]: ordered) {
+            std::uint32_t size{};
+            detail::ReadBytes(snapshot, size);
+            auto entry = snapshot.substr(0, size);
+            snapshot.remove_prefix(size);
+            auto source = static_cast<Source>(entry[0]);
+            entry.remove_prefix(1);
+            if (!flag->snapshotFn) {
+                // Unbound for the length of a Reload, the saved value is skipped.
+                entry = {};
+            }
+            if (source > Source::CommandLine || (flag->snapshotFn && !flag->snapshotFn(nullptr, &entry)) || !entry.empty()) {
+                return bad(name, FlagError::Static("malformed value"));
+            }
+            flag->source = source;
+        }
+        return {};
+    }
+
+    std::optional<Error> FlagSet::LoadSnapshotFile(const std::string &path) {
+        detail::MappedFile file;
+        if (auto err = file.Open(path.c_str())) {
+            return Error(Error::EType::BadFile, -1, {}, {}, std::move(err)).At(path);
+        }
+        files.push_back(std::move(file));
+        return LoadSnapshot(files.back().View());
+    }
+
+    namespace detail {
+        constexpr std::size_t usageWidth = 80;
+        constexpr std::size_t usageMaxColumn = 32;
+
+        /// @returns the name of a flag's value type, from its snapshot tag.
+        FLAGCXX_INLINE std::string_view UsageType(const Flag &flag) {
+            switch ((flag.snapshotType >> 8) & 0xff) {
+                case 1:
+                    return "bool";
+                case 2:
+                    return "float";
+                case 3:
+                    return "int";
+                case 4:
+                    return "uint";
+                case 5:
+                    return "string";
+                case 6:
+                    return "enum";
+                default:
+                    return flag.isBool ? "bool" : "value";
+            }
+        }
+
+        FLAGCXX_INLINE bool UsageRepeated(const Flag &flag) { return (flag.snapshotType >> 16) == 2; }
+
+        /// Appends text to out, wrapped to width columns, with continuation lines indented by
+        /// column. Line breaks in text are kept.
+        FLAGCXX_INLINE void AppendWrapped(String &out, std::string_view text, std::size_t column, std::size_t width) {
+            // Whole lines are appended at once, breaking at the last space that fits.
+            while (true) {
+                auto line = text.substr(0, width + 1);
+                auto end = line.find('\n');
+                if (end == std::string_view::npos) {
+                    if (text.size() <= width) {
+                        out.append(text);
+                        return;
+                    }
+                    end = line.rfind(' ');
+                    if (end == std::string_view::npos || end == 0) {
+                        // A word longer than the line is kept whole.
+                        end = std::min(text.find_first_of(" \n"), text.size());
+                    }
+                }
+                out.append(text.substr(0, end));
+                text.remove_prefix(std::min(end + 1, text.size()));
+                if (text.empty()) {
+                    return;
+                }
+                out.push_back('\n');
+                out.append(column, ' ');
+            }
+        }
+
+        /// Appends text to out as a quoted JSON string.
+        FLAGCXX_INLINE void AppendJson(String &out, std::string_view text) {
+            out.push_back('"');
+            for (auto c: text) {
+                switch (c) {
+                    case '"':
+                        out.append("\\\"");
+                        break;
+                    case '\\':
+                        out.append("\\\\");
+                        break;
+                    case '\n':
+                        out.append("\\n");
+                        break;
+                    case '\t':
+                        out.append("\\t");
+                        break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            constexpr char hex[] = "0123456789abcdef";
+                            out.append("\\u00");
+                            out.push_back(hex[(c >> 4) & 0xf]);
+                            out.push_back(hex[c & 0xf]);
+                        } else {
+                            out.push_back(c);
+                        }
+                }
+            }
+            out.push_back('"');
+        }
+    }// namespace detail
+
+    void FlagSet::renderUsage(UsageFormat format, detail::String &out) {
+        detail::Vector<std::pair<std::string_view, Flag *>> sorted(allocator());
+#if FLAGCXX_FLAT_STORAGE
+        sorted.reserve(slots.size() + flags.Size());
+#else
+        sorted.reserve(slots.size() + flags.size());
+#endif
+        forEach([&sorted](std::string_view name, Flag &flag) { sorted.emplace_back(name, &flag); });
+        std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+        detail::Vector<const Command *> names(allocator());
+        names.reserve(commands.size());
+        for (const auto &command: commands) {
+            names.push_back(&command);
+        }
+        std::sort(names.begin(), names.end(), [](const Command *a, const Command *b) { return a->name < b->name; });
+
+        if (format == UsageFormat::Json) {
+            // Every character of a name or usage escapes to at most six.
+            std::size_t size = 32;
+            for (const auto &[name, flag]: sorted) {
+                size += 64 + 6 * (name.size() + flag->usage.size());
+            }
+            for (auto command: names) {
+                size += 32 + 6 * (command->name.size() + command->usage.size());
+            }
+            out.reserve(size);
+
+            out.append("{\"flags\":[");
+            for (const auto &[name, flag]: sorted) {
+                out.append(out.back() == '[' ? "{\"name\":" : ",{\"name\":");
+                detail::AppendJson(out, name);
+                out.append(",\"type\":\"").append(detail::UsageType(*flag)).append("\",\"repeated\":");
+                out.append(detail::UsageRepeated(*flag) ? "true" : "false").append(",\"usage\":");
+                detail::AppendJson(out, flag->usage);
+                out.push_back('}');
+            }
+            out.append("],\"commands\":[");
+            for (auto command: names) {
+                out.append(out.back() == '[' ? "{\"name\":" : ",{\"name\":");
+                detail::AppendJson(out, command->name);
+                out.append(",\"usage\":");
+                detail::AppendJson(out, command->usage);
+                out.push_back('}');
+            }
+            out.append("]}\n");
+            return;
+        }
+
+        // Each entry is "  -name <type>", padded to a shared column where the usage starts.
+        auto entrySize = [](std::string_view name, const Flag &flag) {
+            auto size = 3 + name.size();
+            if (!flag.isBool) {
+                size += 3 + detail::UsageType(flag).size() + (detail::UsageRepeated(flag) ? 3 : 0);
+            }
+            return size;
+        };
+        std::size_t column = 0;
+        for (const auto &[name, flag]: sorted) {
+            column = std::max(column, entrySize(name, *flag) + 2);
+        }
+        for (auto command: names) {
+            column = std::max(column, 2 + command->name.size() + 2);
+        }
+        column = std::min(column, detail::usageMaxColumn);
+        auto width = detail::usageWidth - column;
+
+        // Wrapping adds at most a line break and an indent for every two characters of usage.
+        std::size_t size = 16;
+        for (const auto &[name, flag]: sorted) {
+            size += entrySize(name, *flag) + 2 + column + flag->usage.size() * (column + 3) / 2;
+        }
+        for (auto command: names) {
+            size += command->name.size() + 4 + column + command->usage.size() * (column + 3) / 2;
+        }
+        out.reserve(size);
+
+        auto appendUsage = [&](std::size_t used, std::string_view usage) {
+            if (usage.empty()) {
+                out.push_back('\n');
+                return;
+            }
+            if (used + 1 > column) {
+                out.push_back('\n');
+                used = 0;
+            }
+            out.append(column - used, ' ');
+            detail::AppendWrapped(out, usage, column, width);
+            out.push_back('\n');
+        };
+        if (!sorted.empty()) {
+            out.append("Flags:\n");
+        }
+        for (const auto &[name, flag]: sorted) {
+            auto start = out.size();
+            out.append("  -").append(name);
+            if (!flag->isBool) {
+                out.append(" <").append(detail::UsageType(*flag)).push_back('>');
+                if (detail::UsageRepeated(*flag)) {
+                    out.append("...");
+                }
+            }
+            appendUsage(out.size() - start, flag->usage);
+        }
+        if (!names.empty()) {
+            out.append(sorted.empty() ? "Commands:\n" : "\nCommands:\n");
+        }
+        for (auto command: names) {
+            out.append("  ").append(command->name);
+            appendUsage(2 + command->name.size(), command->usage);
+        }
+    }
+
+    std::string_view FlagSet::Usage(UsageFormat format) {
+        auto &cached = usageCache[static_cast<std::size_t>(format)];
+        if (cached.empty()) {
+            renderUsage(format, cached);
+        }
+        return cached;
+    }
+
+    bool FlagSet::PrintUsage(int fd, UsageFormat format) {
+        auto text = Usage(format);
+        while (!text.empty()) {
+            auto written = FLAGCXX_WRITE(fd, text.data(), static_cast<unsigned>(text.size()));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            text.remove_prefix(static_cast<std::size_t>(written));
+        }
+        return true;
+    }
+
+    FlagSet &Registered() {
+        static FlagSet registered = [] {
+            FlagSet flags;
+            std::size_t count = 0;
+            for (auto registration = Registration::head; registration != nullptr; registration = registration->next) {
+                ++count;
+            }
+            flags.reserve(count);
+            for (auto registration = Registration::head; registration != nullptr; registration = registration->next) {
+                Flag flag{registration->set, registration->usage, registration->isBool};
+                if (registration->snapshot != nullptr) {
+                    flag.snapshotFn = registration->snapshot;
+                    flag.snapshotType = registration->snapshotType;
+                }
+                flags.add(registration->name, flag);
+            }
+            return flags;
+        }();
+        return registered;
+    }
+
+    namespace detail {
+        template<typename T>
+        std::optional<FlagError> StoreValue(Value &value, std::string_view s) {
+            T parsed{};
+            auto err = MakeSetFn(parsed)(s);
+            if (err) {
+                return err;
+            }
+            value = parsed;
+            return {};
+        }
+
+        FLAGCXX_INLINE std::optional<FlagError> StoreValue(Type type, Value &value, std::string_view s) {
+            switch (type) {
+                case Type::Bool:
+                    return StoreValue<bool>(value, s);
+                case Type::Int:
+                    return StoreValue<std::int64_t>(value, s);
+                case Type::Uint:
+                    return StoreValue<std::uint64_t>(value, s);
+                case Type::Float:
+                    return StoreValue<float>(value, s);
+                case Type::Double:
+                    return StoreValue<double>(value, s);
+                case Type::String:
+                    value = s;
+                    return {};
+            }
+            return {};
+        }
+    }// namespace detail
+
+    bool ParseResult::Has(std::string_view name) const {
+        auto index = schema.Find(name);
+        return index && !std::holds_alternative<std::monostate>(values[*index]);
+    }
+
+    FlagSchema::FlagSchema(std::vector<FlagSpec> specs) : owned(std::move(specs)) {
+        std::stable_sort(owned.begin(), owned.end(), [](const FlagSpec &a, const FlagSpec &b) { return a.name < b.name; });
+        owned.erase(std::unique(owned.begin(), owned.end(), [](const FlagSpec &a, const FlagSpec &b) { return a.name == b.name; }),
+                    owned.end());
+        view = {owned.data(), owned.size()};
+    }
+
+    Span<const Value> BatchResult::Column(std::string_view name) const {
+        if (auto index = schema.Find(name)) {
+            return Column(*index);
+        }
+        return {};
+    }
+
+    std::optional<Flag> FlagSchema::slot(std::string_view name, Value *values, std::size_t stride) const {
+        auto index = view.Find(name);
+        if (!index) {
+            return {};
+        }
+        auto type = view.specs[*index].type;
+        auto value = values + *index * stride;
+        return Flag{[type, value](std::string_view s) { return detail::StoreValue(type, *value, s); },
+                    view.specs[*index].usage, type == Type::Bool};
+    }
+
+    std::optional<Error> FlagSchema::Parse(int argc, const char **argv, ParseResult &result) const {
+        result.schema = view;
+        result.values.assign(view.size, Value{});
+        result.positional.clear();
+
+        return detail::ParseArgv(
+                argc, argv, [&](std::string_view name) { return slot(name, result.values.data(), 1); },
+                [&](const char *const *rest, int count, bool) { detail::AppendViews(result.positional, rest, count); });
+    }
+
+    FlagSet::FlagSet(const FlagSchema &schema) : FlagSet(schema.view, detail::DefaultAllocator()) {}
+
+#if FLAGCXX_HAS_PMR
+    FlagSet::FlagSet(const FlagSchema &schema, std::pmr::memory_resource *resource) : FlagSet(schema.view, resource) {}
+#endif
+}// namespace flag
+
+#endif
@@ -1,14 +1,153 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
 #include <charconv>
-#include <functional>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <variant>
 #include <vector>
 
+#if __has_include(<version>)
+#include <version>
+#endif
+#if defined(__cpp_lib_span) && __cpp_lib_span >= 202002L
+#include <span>
+#endif
+
+// By default flag.h is header-only, and includes the definitions in flag.cpp as inline
+// functions. The flagcxx library compiles them once instead, and its users see only the
+// declarations, with FLAGCXX_HEADER_ONLY defined as 0.
+#ifndef FLAGCXX_HEADER_ONLY
+#define FLAGCXX_HEADER_ONLY 1
+#endif
+#if FLAGCXX_HEADER_ONLY
+#define FLAGCXX_INLINE inline
+#else
+#define FLAGCXX_INLINE
+#endif
+
+// Response and config files are memory-mapped where POSIX mmap is available, and read with
+// C stdio otherwise.
+#ifndef FLAGCXX_HAS_MMAP
+#if __has_include(<sys/mman.h>)
+#define FLAGCXX_HAS_MMAP 1
+#else
+#define FLAGCXX_HAS_MMAP 0
+#endif
+#endif
+
+// Floating point std::from_chars is a late addition to most standard libraries.
+#ifndef FLAGCXX_HAS_FLOAT_FROM_CHARS
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define FLAGCXX_HAS_FLOAT_FROM_CHARS 1
+#else
+#define FLAGCXX_HAS_FLOAT_FROM_CHARS 0
+#endif
+#endif
+
+// Without it, long floating point numbers fall back to strtod, which is called with the C locale
+// where the C library offers strtod_l, so that LC_NUMERIC cannot change the decimal point.
+#ifndef FLAGCXX_HAS_STRTOD_L
+#if defined(__GLIBC__) || defined(__APPLE__)
+#define FLAGCXX_HAS_STRTOD_L 1
+#else
+#define FLAGCXX_HAS_STRTOD_L 0
+#endif
+#endif
+#if FLAGCXX_HAS_STRTOD_L
+#include <locale.h>
+#if defined(__APPLE__)
+#include <xlocale.h>
+#endif
+#endif
+
+// Flags bound outside a schema are kept in a std::unordered_map by default. With
+// FLAGCXX_FLAT_STORAGE set they are packed into contiguous tables instead, which is faster to
+// search and to build but copies the flag names.
+#ifndef FLAGCXX_FLAT_STORAGE
+#define FLAGCXX_FLAT_STORAGE 0
+#endif
+
+// FlagSet can allocate from a std::pmr::memory_resource where the standard library has one.
+#ifndef FLAGCXX_HAS_PMR
+#if defined(__cpp_lib_memory_resource) && __cpp_lib_memory_resource >= 201603L
+#define FLAGCXX_HAS_PMR 1
+#else
+#define FLAGCXX_HAS_PMR 0
+#endif
+#endif
+#if FLAGCXX_HAS_PMR
+#include <memory_resource>
+#endif
+
+// Registrations made with FLAG_DEFINE are constant-initialized where the compiler can enforce it.
+#if defined(__cpp_constinit) && __cpp_constinit >= 201907L
+#define FLAGCXX_CONSTINIT constinit
+#elif defined(__clang__)
+#define FLAGCXX_CONSTINIT [[clang::require_constant_initialization]]
+#else
+#define FLAGCXX_CONSTINIT
+#endif
+
+// Constraint errors are built out of line so the in-range path of a checked setter stays small.
+#if defined(__GNUC__) || defined(__clang__)
+#define FLAGCXX_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define FLAGCXX_NOINLINE __declspec(noinline)
+#else
+#define FLAGCXX_NOINLINE
+#endif
+
 namespace flag {
+    class FlagError {
+    public:
+        /// Creates an error with a message that is copied.
+        explicit FlagError(std::string message) : owned(std::move(message)), message(owned) {}
+
+        /// Creates an error with a message that is referenced without copying, so it must outlive
+        /// the error, as a string literal does.
+        [[nodiscard]] static FlagError Static(std::string_view message) {
+            FlagError error{std::string{}};
+            error.message = message;
+            return error;
+        }
+
+        FlagError(const FlagError &other) : owned(other.owned), message(other.owned.empty() ? other.message : owned) {}
+        FlagError(FlagError &&other) noexcept : owned(std::move(other.owned)), message(owned.empty() ? other.message : owned) {}
+        FlagError &operator=(FlagError other) noexcept {
+            owned = std::move(other.owned);
+            message = owned.empty() ? other.message : owned;
+            return *this;
+        }
+
+        [[nodiscard]] inline std::string_view What() const { return message; }
+
+    private:
+        std::string owned{};
+        std::string_view message{};
+    };
+
+    /// An error from parsing a command line.
+    /// Errors record what went wrong and where, the message is only formatted when What() is
+    /// first called. The flag name and value are views into the parsed arguments.
     class Error {
     public:
         enum class EType {
@@ -18,283 +157,2924 @@ namespace flag {
             UndefinedFlag,
             MissingValue,
             BadValue,
+            BadFile,// A response or config file could not be read.
+            UndefinedCommand,
+            BadSnapshot,// A snapshot is malformed or was saved from different flags.
         };
 
-        Error(EType type, std::string message) : type(type), message(std::move(message)) {}
+        /// Creates an error with a preformatted message.
+        Error(EType type, std::string message) : type(type), message(std::move(message)), formatted(true) {}
+
+        /// Creates an error about the argument at index, formatted on demand.
+        Error(EType type, int index, std::string_view name = {}, std::string_view value = {},
+              std::optional<FlagError> detail = {}, bool isBool = false)
+            : type(type), index(index), views{name, value}, detail(std::move(detail)), isBool(isBool) {}
 
         [[nodiscard]] inline EType Type() const { return type; }
-        [[nodiscard]] inline std::string What() const { return message; }
+
+        /// @returns the index in argv of the offending argument, or -1 if there is none. An
+        /// argument read from a response file reports the index of its @path argument.
+        [[nodiscard]] inline int Index() const { return index; }
+
+        /// @returns the name of the offending flag, if there is one.
+        [[nodiscard]] inline std::string_view Name() const { return views.name; }
+
+        /// @returns the offending value, if there is one.
+        [[nodiscard]] inline std::string_view Value() const { return views.value; }
+
+        /// Records that the error is about the argument at index in argv.
+        inline void Reindex(int argument) { index = argument; }
+
+        /// Copies the name and value into the error, so that it stays valid once the arguments or
+        /// files they were parsed from are gone.
+        inline void Own() {
+            views.owned.assign(views.name).append(views.value);
+            views.Rebase(views.name.size(), views.value.size());
+        }
+
+        /// @returns the defined flag closest to an undefined one, empty if none is close.
+        [[nodiscard]] inline std::string_view Suggestion() const {
+            return type == EType::UndefinedFlag && detail ? detail->What() : std::string_view{};
+        }
+
+        /// Records that an undefined flag was probably meant to be suggestion.
+        inline Error &&Suggest(std::string_view suggestion) && {
+            detail = FlagError(std::string(suggestion));
+            return std::move(*this);
+        }
+
+        /// @returns the config file the error is in, empty if it did not come from one.
+        [[nodiscard]] inline const std::string &File() const { return file; }
+
+        /// @returns the 1-based line of the error in its config file, 0 if there is none.
+        [[nodiscard]] inline int Line() const { return line; }
+
+        /// @returns the 1-based column of the error in its config file, 0 if there is none.
+        [[nodiscard]] inline int Column() const { return column; }
+
+        /// Records that the error is in the config file at path, at line and column if they
+        /// are not 0.
+        inline Error &&At(std::string path, int atLine = 0, int atColumn = 0) && {
+            file = std::move(path);
+            line = atLine;
+            column = atColumn;
+            return std::move(*this);
+        }
+
+        /// @returns the human-readable message, formatted on the first call.
+        [[nodiscard]] FLAGCXX_INLINE const std::string &What() const;
 
     private:
+        /// The name and value, as views into the parsed arguments or, once owned, into a copy
+        /// that moves and copies with the error.
+        struct Views {
+            std::string_view name{};
+            std::string_view value{};
+            std::string owned{};
+
+            Views() = default;
+            Views(std::string_view name, std::string_view value) : name(name), value(value) {}
+            Views(const Views &other) : name(other.name), value(other.value), owned(other.owned) {
+                Rebase(other.name.size(), other.value.size());
+            }
+            Views(Views &&other) noexcept : name(other.name), value(other.value), owned(std::move(other.owned)) {
+                Rebase(other.name.size(), other.value.size());
+            }
+            Views &operator=(Views other) noexcept {
+                name = other.name;
+                value = other.value;
+                owned = std::move(other.owned);
+                Rebase(other.name.size(), other.value.size());
+                return *this;
+            }
+
+            void Rebase(std::size_t nameSize, std::size_t valueSize) {
+                if (!owned.empty()) {
+                    name = std::string_view(owned).substr(0, nameSize);
+                    value = std::string_view(owned).substr(nameSize, valueSize);
+                }
+            }
+        };
+
         EType type;
-        std::string message;
+        int index{-1};
+        Views views;
+        std::optional<FlagError> detail{};
+        bool isBool{false};
+
+        std::string file{};
+        int line{0};
+        int column{0};
+
+        mutable std::string message{};
+        mutable bool formatted{false};
     };
 
-    class FlagError {
+#if defined(__cpp_lib_span) && __cpp_lib_span >= 202002L
+    template<typename T>
+    using Span = std::span<T>;
+#else
+    /// A minimal stand-in for C++20 std::span: a pointer and a size over contiguous elements.
+    template<typename T>
+    class Span {
     public:
-        explicit FlagError(std::string message) : message(std::move(message)) {}
+        constexpr Span() = default;
+        constexpr Span(T *data, std::size_t size) : ptr(data), count(size) {}
+
+        template<typename Container, typename = std::enable_if_t<std::is_convertible_v<decltype(std::declval<Container &>().data()), T *>>>
+        constexpr Span(Container &container) : ptr(container.data()), count(container.size()) {}
 
-        [[nodiscard]] inline std::string What() const { return message; }
+        [[nodiscard]] constexpr T *data() const { return ptr; }
+        [[nodiscard]] constexpr std::size_t size() const { return count; }
+        [[nodiscard]] constexpr bool empty() const { return count == 0; }
+        [[nodiscard]] constexpr T *begin() const { return ptr; }
+        [[nodiscard]] constexpr T *end() const { return ptr + count; }
+        [[nodiscard]] constexpr T &front() const { return ptr[0]; }
+        [[nodiscard]] constexpr T &back() const { return ptr[count - 1]; }
+        [[nodiscard]] constexpr T &operator[](std::size_t i) const { return ptr[i]; }
+        [[nodiscard]] constexpr Span subspan(std::size_t offset, std::size_t size) const { return {ptr + offset, size}; }
+        [[nodiscard]] constexpr Span subspan(std::size_t offset) const { return {ptr + offset, count - offset}; }
 
     private:
-        std::string message;
+        T *ptr{nullptr};
+        std::size_t count{0};
+    };
+#endif
+
+    namespace detail {
+        /// The allocator of FlagSet's internal containers: a polymorphic allocator over the
+        /// FlagSet's memory resource, or std::allocator without std::pmr.
+#if FLAGCXX_HAS_PMR
+        using Allocator = std::pmr::polymorphic_allocator<std::byte>;
+
+        /// Allocates with the global operator new and delete, as std::allocator does, unlike
+        /// std::pmr::new_delete_resource, which may use their aligned forms.
+        class HeapResource final : public std::pmr::memory_resource {
+        private:
+            void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+                if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+                    return ::operator new(bytes, std::align_val_t(alignment));
+                }
+                return ::operator new(bytes);
+            }
+            void do_deallocate(void *p, std::size_t, std::size_t alignment) override {
+                if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+                    ::operator delete(p, std::align_val_t(alignment));
+                } else {
+                    ::operator delete(p);
+                }
+            }
+            bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+        };
+
+        /// Constant-initialized, so that it outlives every FlagSet with static storage.
+        FLAGCXX_CONSTINIT inline HeapResource heap{};
+
+        inline Allocator DefaultAllocator() { return Allocator(&heap); }
+#else
+        using Allocator = std::allocator<std::byte>;
+
+        inline Allocator DefaultAllocator() { return {}; }
+#endif
+        template<typename T>
+        using Rebind = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+        template<typename T>
+        using Vector = std::vector<T, Rebind<T>>;
+        using String = std::basic_string<char, std::char_traits<char>, Rebind<char>>;
+        template<typename K, typename V>
+        using HashMap = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, Rebind<std::pair<const K, V>>>;
+
+        template<typename Signature, std::size_t Capacity = 3 * sizeof(void *)>
+        class InplaceFunction;
+
+        /// A callable wrapper that stores a small, trivially copyable callable inline.
+        /// Unlike std::function it never allocates, and copying it is a plain byte copy.
+        template<typename R, typename... Args, std::size_t Capacity>
+        class InplaceFunction<R(Args...), Capacity> {
+        public:
+            InplaceFunction() = default;
+
+            template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, InplaceFunction>>>
+            InplaceFunction(F fn) {
+                static_assert(std::is_trivially_copyable_v<F>, "callable must be trivially copyable");
+                static_assert(sizeof(F) <= Capacity, "callable is too large to be stored inline");
+                static_assert(alignof(F) <= alignof(void *), "callable is over-aligned");
+                ::new (static_cast<void *>(storage)) F(fn);
+                thunk = [](const void *callable, Args... args) -> R {
+                    return (*static_cast<const F *>(callable))(std::forward<Args>(args)...);
+                };
+            }
+
+            R operator()(Args... args) const { return thunk(storage, std::forward<Args>(args)...); }
+
+            explicit operator bool() const { return thunk != nullptr; }
+
+        private:
+            R (*thunk)(const void *, Args...){nullptr};
+            alignas(void *) unsigned char storage[Capacity]{};
+        };
+    }// namespace detail
+
+    /// Where a flag's value came from, in increasing order of precedence.
+    enum class Source : std::uint8_t {
+        Default,    // Never set, the variable keeps its initial value.
+        File,       // Set by FlagSet::ParseFile.
+        Environment,// Set by FlagSet::ParseEnv.
+        CommandLine,// Set by FlagSet::Parse.
     };
 
+    namespace detail {
+        /// The steps of a FlagSet::Reload, applied to each flag bound to a Live.
+        enum class LiveOp {
+            Stage,  // Start a fresh snapshot, a copy of the current one, for setters to write.
+            Publish,// Make the staged snapshot current.
+            Discard,// Drop the staged snapshot.
+        };
+    }// namespace detail
+
     struct Flag {
-        using SetFn = std::function<std::optional<FlagError>(std::string_view)>;
+        using SetFn = detail::InplaceFunction<std::optional<FlagError>(std::string_view)>;
+        using ResolveFn = detail::InplaceFunction<std::optional<FlagError>(std::string_view &raw)>;
+        using LiveFn = detail::InplaceFunction<void(detail::LiveOp)>;
+        using SnapshotFn = detail::InplaceFunction<bool(std::string *out, std::string_view *in)>;
+        using ResetFn = detail::InplaceFunction<void(), 2 * sizeof(void *)>;
 
         Flag(SetFn fn, std::string_view usage, bool isBool = false) : setFn(std::move(fn)), usage(usage), isBool(isBool) {}
 
         SetFn setFn;
         std::string_view usage{};
         bool isBool{false};
+        Source source{Source::Default};
+        std::uint32_t id{0};// The flag's position in its FlagSet, in registration order.
+
+        /// Converts a deferred value and reports the argument it came from, set only for flags
+        /// bound to a Lazy.
+        ResolveFn resolveFn{};
+
+        /// Stages and publishes snapshots during a Reload, set only for flags that Reload may
+        /// write: those bound to a Live, and to a std::atomic, which has nothing to stage.
+        LiveFn liveFn{};
+
+        /// Appends the variable's value to out, or reads it from the front of in, for binary
+        /// snapshots. Reading consumes the bytes read, and returns false if they are malformed.
+        /// snapshotType identifies the value's layout, 0 for flags that are not saved.
+        SnapshotFn snapshotFn{};
+        std::uint32_t snapshotType{0};
+
+        /// Truncates the variable to the elements it held when bound, set only for list flags,
+        /// which append rather than overwrite.
+        ResetFn resetFn{};
     };
 
-    class FlagSet {
+    namespace detail {
+        /// Drops what lower-precedence sources appended to a list flag before source first writes
+        /// it, so that the result does not depend on the order the sources are parsed in.
+        inline void Supersede(Flag &flag, Source source) {
+            if (flag.source != Source::Default && flag.source < source && flag.resetFn) {
+                flag.resetFn();
+            }
+        }
+    }// namespace detail
+
+    class FlagSet;
+
+    /// A flag value that Parse only records, converting it the first time it is read.
+    /// The recorded argument is a view into the parsed argv, which must still be alive when
+    /// the value is first read. Reads are not synchronized: resolve the value, for example
+    /// with FlagSet::Validate, before reading it from several threads.
+    template<typename T>
+    class Lazy {
     public:
-        /// Parses a command line.
-        /// @returns an optional error if one occurred.
-        [[nodiscard]] std::optional<Error> Parse(int argc, const char **argv);
+        Lazy() = default;
+        explicit Lazy(T defaultValue) : value(defaultValue), fallback(std::move(defaultValue)) {}
 
-        template<typename T>
-        inline void Var(T &var, std::string_view name, std::string_view usage);
+        /// @returns whether the flag was given on the command line.
+        [[nodiscard]] inline bool IsSet() const { return raw.has_value(); }
 
-        template<typename T>
-        inline void Var(std::optional<T> &var, std::string_view name, std::string_view usage);
+        /// @returns the argument recorded for the flag, unconverted.
+        [[nodiscard]] inline std::string_view Raw() const { return raw.value_or(std::string_view{}); }
 
-        /// Returns whether a command line has been parsed.
-        [[nodiscard]] inline bool Parsed() const { return parsed; }
+        /// @returns the value, converting it on the first call. If the flag was not given,
+        /// or its argument did not convert, this is the default value.
+        [[nodiscard]] inline const T &Get() const {
+            if (!resolved) {
+                Resolve();
+            }
+            return value;
+        }
+        [[nodiscard]] inline const T &operator*() const { return Get(); }
+        [[nodiscard]] inline const T *operator->() const { return &Get(); }
 
-        /// @returns the arguments remaining after flag parsing.
-        [[nodiscard]] inline const std::vector<std::string> &Args() const { return args; }
+        /// Converts the recorded argument now, if it has not been already.
+        /// @returns the conversion error, if there was one.
+        inline std::optional<FlagError> Resolve() const;
 
     private:
-        bool parsed{false};
+        friend class FlagSet;
 
-        std::vector<std::string> args{};
-        std::unordered_map<std::string_view, Flag> flags{};
+        std::optional<std::string_view> raw{};
+        mutable T value{};
+        T fallback{};
+        mutable bool resolved{true};
+        mutable std::optional<FlagError> error{};
     };
 
-    std::optional<Error> FlagSet::Parse(int argc, const char **argv) {
-        parsed = true;
+    namespace detail {
+        /// Quiescent-state based reclamation of retired Live snapshots. Threads that read Live
+        /// values register a reader record with it and mark quiescent states, points where they
+        /// hold no references to Live values. A snapshot retired at epoch e is deleted once every
+        /// registered reader has marked a quiescent state at epoch e or later.
+        class Reclaimer {
+        public:
+            struct alignas(64) Reader {
+                std::atomic<std::uint64_t> seen{0};
+            };
 
-        if (argc < 1) {
-            return Error(Error::EType::NumArgs, "At least 1 argument is needed.");
-        }
+            static Reclaimer &Instance() {
+                static Reclaimer instance;
+                return instance;
+            }
 
-        // Drop program name.
-        argc--;
-        argv++;
+            Reclaimer() = default;
+            Reclaimer(const Reclaimer &) = delete;
+            Reclaimer &operator=(const Reclaimer &) = delete;
+            ~Reclaimer() {
+                for (auto &snapshot: retired) {
+                    snapshot.destroy(snapshot.data);
+                }
+            }
 
-        while (argc) {
-            auto s = std::string_view(*argv);
-            if (s.size() < 2 || s[0] != '-') {
-                // Flags have ended, positional arguments from here on.
-                break;
+            inline void Quiescent(Reader &reader) const {
+                reader.seen.store(epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
             }
 
-            auto numMinuses = 1;
-            if (s[1] == '-') {
-                numMinuses++;
-                if (s.size() == 2) {
-                    // Argument is --, terminate flags.
-                    argc--;
-                    argv++;
-                    break;
-                }
+            void Register(Reader &reader) {
+                std::lock_guard<std::mutex> lock{mutex};
+                Quiescent(reader);
+                readers.push_back(&reader);
             }
-            argc--;
-            argv++;
 
-            s.remove_prefix(numMinuses);
-            if (s[0] == '-' || s[0] == '=') {
-                std::stringstream ss;
-                ss << "Bad flag syntax: " << s;
-                return Error(Error::EType::BadSyntax, ss.str());
+            void Unregister(Reader &reader) {
+                std::lock_guard<std::mutex> lock{mutex};
+                readers.erase(std::find(readers.begin(), readers.end(), &reader));
+                reclaim();
             }
 
-            // it's a flag, does it have a value?
-            auto hasValue = false;
-            std::string_view value{};
-            for (size_t i = 1; i < s.size(); ++i) {
-                if (s[i] == '=') {
-                    value = s;
-                    value.remove_prefix(i + 1);
-                    s.remove_suffix(s.size() - i);
-                    hasValue = true;
+            /// Takes ownership of a snapshot that was just replaced, destroy deletes it.
+            void Retire(void *data, void (*destroy)(void *)) {
+                std::lock_guard<std::mutex> lock{mutex};
+                retired.push_back({data, destroy, epoch.fetch_add(1, std::memory_order_seq_cst) + 1});
+                reclaim();
+            }
+
+            /// Deletes the retired snapshots no registered reader can still refer to.
+            void Reclaim() {
+                std::lock_guard<std::mutex> lock{mutex};
+                reclaim();
+            }
+
+        private:
+            struct Snapshot {
+                void *data;
+                void (*destroy)(void *);
+                std::uint64_t epoch;
+            };
+
+            void reclaim() {
+                auto oldest = epoch.load(std::memory_order_seq_cst);
+                for (auto reader: readers) {
+                    oldest = std::min(oldest, reader->seen.load(std::memory_order_seq_cst));
                 }
+                auto kept = std::remove_if(retired.begin(), retired.end(), [oldest](const Snapshot &snapshot) {
+                    if (snapshot.epoch > oldest) {
+                        return false;
+                    }
+                    snapshot.destroy(snapshot.data);
+                    return true;
+                });
+                retired.erase(kept, retired.end());
             }
-            auto name = s;
 
-            // Search for the flag name in the flags.
-            auto flag = flags.find(name);
-            if (flag == flags.end()) {
-                // Not found in flags.
-                if (name == "help" || name == "h") {
-                    // Special case for usage.
-                    return Error(Error::EType::Help, "");
+            std::atomic<std::uint64_t> epoch{1};
+            std::mutex mutex{};
+            std::vector<Reader *> readers{};
+            std::vector<Snapshot> retired{};
+        };
+    }// namespace detail
+
+    /// Registers the calling thread as a reader of Live values for the guard's lifetime.
+    /// References returned by Live::Get stay valid until the thread next calls Quiescent, which
+    /// a request loop would do between requests. Snapshots replaced by a Reload are reclaimed once
+    /// every reader has done so.
+    class LiveReader {
+    public:
+        LiveReader() { detail::Reclaimer::Instance().Register(reader); }
+        ~LiveReader() { detail::Reclaimer::Instance().Unregister(reader); }
+        LiveReader(const LiveReader &) = delete;
+        LiveReader &operator=(const LiveReader &) = delete;
+
+        /// Marks a point where the thread holds no references to Live values.
+        inline void Quiescent() { detail::Reclaimer::Instance().Quiescent(reader); }
+
+    private:
+        detail::Reclaimer::Reader reader{};
+    };
+
+    /// A flag value that FlagSet::Reload can replace while other threads read it.
+    /// Each Reload publishes a new snapshot with a single atomic store, and Get reads it with a
+    /// single acquire load, without locks or reference counts. Threads that read the value
+    /// while Reloads may run must hold a LiveReader. Parse, ParseEnv and ParseFile write the
+    /// current snapshot in place and must only run before readers start.
+    template<typename T>
+    class Live {
+    public:
+        Live() : Live(T{}) {}
+        explicit Live(T defaultValue) : current(new T(std::move(defaultValue))) {}
+        Live(const Live &) = delete;
+        Live &operator=(const Live &) = delete;
+        ~Live() { delete current.load(std::memory_order_relaxed); }
+
+        /// @returns the current value, valid until the calling thread's next quiescent state.
+        [[nodiscard]] inline const T &Get() const { return *current.load(std::memory_order_acquire); }
+        [[nodiscard]] inline const T &operator*() const { return Get(); }
+        [[nodiscard]] inline const T *operator->() const { return &Get(); }
+
+    private:
+        friend class FlagSet;
+
+        /// @returns the snapshot setters write: the staged one during a Reload, else the current one.
+        T &target() { return staged ? *staged : *current.load(std::memory_order_relaxed); }
+
+        void apply(detail::LiveOp op) {
+            switch (op) {
+                case detail::LiveOp::Stage:
+                    staged = std::make_unique<T>(*current.load(std::memory_order_relaxed));
+                    break;
+                case detail::LiveOp::Publish: {
+                    auto old = current.exchange(staged.release(), std::memory_order_acq_rel);
+                    detail::Reclaimer::Instance().Retire(old, [](void *data) { delete static_cast<T *>(data); });
+                    break;
                 }
-                std::stringstream ss;
-                ss << "Flag provided but not defined: " << name;
-                return Error(Error::EType::UndefinedFlag, ss.str());
+                case detail::LiveOp::Discard:
+                    staged.reset();
+                    break;
             }
+        }
 
-            auto flagVal = flag->second;
-            if (flagVal.isBool) {
-                if (hasValue) {
-                    auto err = flagVal.setFn(value);
-                    if (err) {
-                        std::stringstream ss;
-                        ss << "Bad boolean value " << value << " for flag " << name << ": " << err->What();
-                        return Error(Error::EType::BadValue, ss.str());
-                    }
-                } else {
-                    auto err = flagVal.setFn("true");
-                    if (err) {
-                        std::stringstream ss;
-                        ss << "Bad boolean flag " << name << ": " << err->What();
-                        return Error(Error::EType::BadValue, ss.str());
+        std::atomic<T *> current;
+        std::unique_ptr<T> staged{};
+    };
+
+    /// The value type of a flag declared in a Schema.
+    enum class Type {
+        Bool,
+        Int, // Signed, stored as int64_t.
+        Uint,// Unsigned, stored as uint64_t.
+        Float,
+        Double,
+        String,
+    };
+
+    /// Declares a single flag in a Schema.
+    struct FlagSpec {
+        std::string_view name{};
+        std::string_view usage{};
+        Type type{Type::String};
+    };
+
+    namespace detail {
+        // Deliberately not constexpr: reaching it while building a Schema in a
+        // constant expression turns a duplicate flag name into a compile error.
+        inline void DuplicateFlagInSchema() {
+            assert(false && "duplicate flag name in flag::Schema");
+        }
+
+        /// A type-erased view of a Schema's sorted flag table.
+        struct SchemaView {
+            const FlagSpec *specs{nullptr};
+            std::size_t size{0};
+
+            [[nodiscard]] constexpr std::optional<std::size_t> Find(std::string_view name) const {
+                std::size_t lo = 0;
+                std::size_t hi = size;
+                while (lo < hi) {
+                    auto mid = lo + (hi - lo) / 2;
+                    if (specs[mid].name < name) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
                     }
                 }
-            } else {
-                if (!hasValue && argc > 0) {
-                    hasValue = true;
-                    value = *argv;
-                    argc++;
-                    argv++;
-                }
-                if (!hasValue) {
-                    std::stringstream ss;
-                    ss << "Flag is missing a value: " << name;
-                    return Error(Error::EType::MissingValue, ss.str());
-                }
-                auto err = flagVal.setFn(value);
-                if (err) {
-                    std::stringstream ss;
-                    ss << "Bad value " << value << " for flag " << name << ": " << err->What();
-                    return Error(Error::EType::BadValue, ss.str());
+                if (lo < size && specs[lo].name == name) {
+                    return lo;
+                }
+                return {};
+            }
+        };
+    }// namespace detail
+
+    /// A fixed set of flag declarations, sorted by name when the Schema is constructed.
+    /// Declared constexpr, the table is built at compile time and lookups are a binary
+    /// search over it: nothing is hashed and no map is built at runtime.
+    template<std::size_t N>
+    class Schema {
+    public:
+        constexpr explicit Schema(const FlagSpec (&declared)[N]) {
+            for (std::size_t i = 0; i < N; ++i) {
+                // Insertion sort, std::sort is not constexpr until C++20.
+                auto spec = declared[i];
+                auto j = i;
+                while (j > 0 && spec.name < specs[j - 1].name) {
+                    specs[j] = specs[j - 1];
+                    --j;
+                }
+                specs[j] = spec;
+            }
+            for (std::size_t i = 1; i < N; ++i) {
+                if (specs[i].name == specs[i - 1].name) {
+                    detail::DuplicateFlagInSchema();
                 }
             }
         }
 
-        // Slurp up remaining positional arguments.
-        while (argc) {
-            args.emplace_back(*argv);
-            argc--;
-            argv++;
+        [[nodiscard]] constexpr std::size_t Size() const { return N; }
+        [[nodiscard]] constexpr const FlagSpec &operator[](std::size_t i) const { return specs[i]; }
+        [[nodiscard]] constexpr const FlagSpec *begin() const { return specs.data(); }
+        [[nodiscard]] constexpr const FlagSpec *end() const { return specs.data() + N; }
+
+        /// @returns the index of the named flag in the sorted table, if it is declared.
+        [[nodiscard]] constexpr std::optional<std::size_t> Find(std::string_view name) const {
+            return View().Find(name);
         }
 
-        return {};
+        [[nodiscard]] constexpr detail::SchemaView View() const { return {specs.data(), N}; }
+
+    private:
+        std::array<FlagSpec, N> specs{};
+    };
+
+    /// Builds a Schema from a braced list of {name, usage, type} declarations.
+    template<std::size_t N>
+    constexpr Schema<N> MakeSchema(const FlagSpec (&specs)[N]) {
+        return Schema<N>(specs);
     }
 
     namespace detail {
-        template<typename T>
-        Flag::SetFn MakeSetFn(T &var);
+        // Deliberately not constexpr, like DuplicateFlagInSchema.
+        inline void DuplicateNameInEnum() {
+            assert(false && "duplicate name in flag::Enum");
+        }
 
-        template<>
-        Flag::SetFn MakeSetFn(int &var) {
-            return [&](std::string_view s) {
-                auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), var);
-                if (ec == std::errc::invalid_argument) {
-                    return std::optional<FlagError>{FlagError("number is not an integer")};
+        inline void BadPattern() {
+            assert(false && "unterminated [ or trailing \\ in flag::Pattern");
+        }
+
+        /// a < b, comparing signed and unsigned integers by value, as C++20 std::cmp_less does.
+        template<typename A, typename B>
+        constexpr bool Less(A a, B b) {
+            if constexpr (std::is_integral_v<A> && std::is_integral_v<B> && std::is_signed_v<A> != std::is_signed_v<B>) {
+                if constexpr (std::is_signed_v<A>) {
+                    return a < 0 || static_cast<std::make_unsigned_t<A>>(a) < b;
+                } else {
+                    return b >= 0 && a < static_cast<std::make_unsigned_t<B>>(b);
                 }
-                if (ec == std::errc::result_out_of_range) {
-                    return std::optional<FlagError>{FlagError("number is out of range")};
+            } else {
+                return a < b;
+            }
+        }
+
+        /// Appends a number to out in its shortest form.
+        template<typename T>
+        void AppendNumber(std::string &out, T value) {
+            if constexpr (std::is_integral_v<T> || FLAGCXX_HAS_FLOAT_FROM_CHARS) {
+                std::array<char, 64> text{};
+                auto end = std::to_chars(text.data(), text.data() + text.size(), value).ptr;
+                out.append(text.data(), static_cast<std::size_t>(end - text.data()));
+            } else {
+                // Fixed notation with six decimals, less its trailing zeros.
+                auto text = std::to_string(value);
+                text.erase(text.find_last_not_of('0') + 1);
+                if (text.back() == '.') {
+                    text.pop_back();
                 }
-                return std::optional<FlagError>{};
-            };
+                out.append(text);
+            }
         }
+    }// namespace detail
 
-        template<>
-        Flag::SetFn MakeSetFn(float &var) {
-            return [&](std::string_view s) {
-                std::stringstream ss;
-                ss << s;
-                ss >> var;
-                if (ss.fail()) {
-                    return std::optional<FlagError>{FlagError("number is not a float")};
+    /// A constraint that accepts numbers in [min, max]. Bounds and values of different
+    /// arithmetic types are compared by value, so Range(1, 256) also constrains a std::size_t.
+    template<typename T>
+    struct Range {
+        static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "ranges must be numeric");
+
+        T min;
+        T max;
+
+        constexpr Range(T min, T max) : min(min), max(max) {}
+
+        template<typename V>
+        [[nodiscard]] std::optional<FlagError> Check(const V &value) const {
+            // NaN compares false both ways, so it is rejected explicitly rather than let through.
+            if constexpr (std::is_floating_point_v<V>) {
+                if (value != value) {
+                    return OutOfRange();
                 }
-                return std::optional<FlagError>{};
-            };
+            }
+            if (!detail::Less(value, min) && !detail::Less(max, value)) {
+                return {};
+            }
+            return OutOfRange();
         }
 
-        template<>
-        Flag::SetFn MakeSetFn(double &var) {
-            return [&](std::string_view s) {
-              std::stringstream ss;
-              ss << s;
-              ss >> var;
-              if (ss.fail()) {
-                  return std::optional<FlagError>{FlagError("number is not a double")};
-              }
-              return std::optional<FlagError>{};
-            };
+        /// @returns the error for a value outside the range, naming the bounds.
+        [[nodiscard]] FLAGCXX_NOINLINE FlagError OutOfRange() const {
+            std::string message{"number must be between "};
+            detail::AppendNumber(message, min);
+            message.append(" and ");
+            detail::AppendNumber(message, max);
+            return FlagError(std::move(message));
         }
+    };
 
-        template<>
-        Flag::SetFn MakeSetFn(std::string &var) {
-            return [&](std::string_view s) {
-                var = s;
-                return std::optional<FlagError>{};
-            };
+    /// A constraint that accepts strings matching a pattern as a whole. In the pattern, ?
+    /// matches any character, * any run of characters, [abc] or [a-z] one character of a set,
+    /// [!a-z] one character outside it, and \ makes the next character literal. Matching takes
+    /// no regex engine and never allocates. The pattern must outlive the FlagSet, which it does
+    /// when it is a string literal.
+    class Pattern {
+    public:
+        constexpr explicit Pattern(std::string_view pattern) : pattern(pattern) {
+            for (std::size_t p = 0; p < pattern.size(); p = skip(p)) {
+                if (skip(p) > pattern.size()) {
+                    // Outside constant expressions, the bad element is dropped.
+                    detail::BadPattern();
+                    this->pattern = pattern.substr(0, p);
+                    break;
+                }
+            }
         }
 
-        template<>
-        Flag::SetFn MakeSetFn(bool &var) {
-            static constexpr std::array<std::string_view, 4> trueValues{"true", "t", "yes", "y"};
-            static constexpr std::array<std::string_view, 5> falseValues{"false", "f", "no", "n"};
-            return [&](std::string_view s) -> std::optional<FlagError> {
-                if (s.empty()) {
-                    var = true;
+        /// @returns whether text matches the whole pattern.
+        [[nodiscard]] constexpr bool Matches(std::string_view text) const {
+            // A * that fails to match is retried one character longer. Only the last * needs
+            // retrying: an earlier one can always swallow what a later one would have.
+            auto p = std::size_t{0};
+            auto t = std::size_t{0};
+            auto star = std::string_view::npos;
+            auto starText = std::size_t{0};
+            while (t < text.size()) {
+                if (p < pattern.size() && pattern[p] == '*') {
+                    star = ++p;
+                    starText = t;
+                } else if (p < pattern.size() && matchOne(p, text[t])) {
+                    p = skip(p);
+                    ++t;
+                } else if (star != std::string_view::npos) {
+                    p = star;
+                    t = ++starText;
                 } else {
-                    if (std::find(trueValues.begin(), trueValues.end(), s) != trueValues.end()) {
-                        var = true;
-                    } else if (std::find(falseValues.begin(), falseValues.end(), s) != falseValues.end()) {
-                        var = false;
-                    } else {
-                        return FlagError("Unknown boolean value");
-                    }
+                    return false;
                 }
+            }
+            while (p < pattern.size() && pattern[p] == '*') {
+                ++p;
+            }
+            return p == pattern.size();
+        }
+
+        template<typename V>
+        [[nodiscard]] std::optional<FlagError> Check(const V &value) const {
+            if (Matches(std::string_view(value))) {
                 return {};
-            };
+            }
+            return Mismatch();
         }
 
-        template<typename T>
-        Flag::SetFn MakeOptionalSetFn(std::optional<T>& var) {
-            return [&](std::string_view s) {
-                T tmp{};
-                auto err = MakeSetFn(tmp)(s);
-                if (err) {
-                    return err;
+        /// @returns the error for a value that does not match, quoting the pattern.
+        [[nodiscard]] FLAGCXX_NOINLINE FlagError Mismatch() const { return FlagError(std::string("value does not match ").append(pattern)); }
+
+    private:
+        /// @returns the position after the pattern element at p, past the end if it is
+        /// unterminated.
+        [[nodiscard]] constexpr std::size_t skip(std::size_t p) const {
+            if (pattern[p] == '\\') {
+                return p + 2;
+            }
+            if (pattern[p] != '[') {
+                return p + 1;
+            }
+            auto q = p + 1;
+            if (q < pattern.size() && pattern[q] == '!') {
+                ++q;
+            }
+            // A ] first in the set is a member, not its end.
+            if (q < pattern.size() && pattern[q] == ']') {
+                ++q;
+            }
+            while (q < pattern.size() && pattern[q] != ']') {
+                ++q;
+            }
+            return q + 1;
+        }
+
+        /// @returns whether the pattern element at p, which is not *, matches c.
+        [[nodiscard]] constexpr bool matchOne(std::size_t p, char c) const {
+            switch (pattern[p]) {
+                case '?':
+                    return true;
+                case '\\':
+                    return pattern[p + 1] == c;
+                case '[': {
+                    auto end = skip(p) - 1;
+                    auto q = p + 1;
+                    auto negated = pattern[q] == '!';
+                    q += negated ? 1 : 0;
+                    auto found = false;
+                    for (; q < end; ++q) {
+                        if (q + 2 < end && pattern[q + 1] == '-') {
+                            found = found || (pattern[q] <= c && c <= pattern[q + 2]);
+                            q += 2;
+                        } else {
+                            found = found || pattern[q] == c;
+                        }
+                    }
+                    return found != negated;
                 }
-                var = tmp;
-                return std::optional<FlagError>{};
-            };
+                default:
+                    return pattern[p] == c;
+            }
         }
-    }// namespace detail
 
-    template<typename T>
+        std::string_view pattern;
+    };
+
+    /// A name for an enumerator, declared in an Enum.
+    template<typename E>
+    struct EnumName {
+        std::string_view name{};
+        E value{};
+    };
+
+    /// The names of an enum flag's values, sorted when the Enum is constructed. Declared
+    /// constexpr, the table is built at compile time and Parse finds a name with a binary
+    /// search over it.
+    template<typename E, std::size_t N>
+    class Enum {
+    public:
+        static_assert(std::is_enum_v<E>, "Enum names the values of an enum type");
+
+        constexpr explicit Enum(const EnumName<E> (&declared)[N]) {
+            for (std::size_t i = 0; i < N; ++i) {
+                // Insertion sort, std::sort is not constexpr until C++20.
+                auto entry = declared[i];
+                auto j = i;
+                while (j > 0 && entry.name < names[j - 1].name) {
+                    names[j] = names[j - 1];
+                    --j;
+                }
+                names[j] = entry;
+            }
+            for (std::size_t i = 1; i < N; ++i) {
+                if (names[i].name == names[i - 1].name) {
+                    detail::DuplicateNameInEnum();
+                }
+            }
+        }
+
+        [[nodiscard]] constexpr std::size_t Size() const { return N; }
+        [[nodiscard]] constexpr const EnumName<E> *begin() const { return names.data(); }
+        [[nodiscard]] constexpr const EnumName<E> *end() const { return names.data() + N; }
+
+        /// @returns the enumerator called name, if there is one.
+        [[nodiscard]] constexpr std::optional<E> Find(std::string_view name) const {
+            std::size_t lo = 0;
+            std::size_t hi = N;
+            while (lo < hi) {
+                auto mid = lo + (hi - lo) / 2;
+                if (names[mid].name < name) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo < N && names[lo].name == name) {
+                return names[lo].value;
+            }
+            return {};
+        }
+
+        /// @returns the error for a value that names no enumerator, listing the names.
+        [[nodiscard]] FLAGCXX_NOINLINE FlagError Unknown() const {
+            std::string message{"value must be one of "};
+            for (std::size_t i = 0; i < N; ++i) {
+                message.append(i == 0 ? "" : ", ").append(names[i].name);
+            }
+            return FlagError(std::move(message));
+        }
+
+    private:
+        std::array<EnumName<E>, N> names{};
+    };
+
+    /// Builds an Enum from a braced list of {name, value} pairs, for example
+    /// flag::MakeEnum<Mode>({{"fast", Mode::Fast}, {"safe", Mode::Safe}}).
+    template<typename E, std::size_t N>
+    constexpr Enum<E, N> MakeEnum(const EnumName<E> (&names)[N]) {
+        return Enum<E, N>(names);
+    }
+
+    namespace detail {
+        /// A read-only view of a whole file, memory-mapped where the platform supports it.
+        /// Moving a MappedFile does not move its contents, views into it stay valid.
+        class MappedFile {
+        public:
+            MappedFile() = default;
+            MappedFile(const MappedFile &) = delete;
+            MappedFile &operator=(const MappedFile &) = delete;
+            MappedFile(MappedFile &&other) noexcept { swap(other); }
+            MappedFile &operator=(MappedFile &&other) noexcept {
+                swap(other);
+                return *this;
+            }
+            FLAGCXX_INLINE ~MappedFile();
+
+            /// Maps the file at path.
+            /// @returns an error describing why the file could not be read.
+            [[nodiscard]] FLAGCXX_INLINE std::optional<FlagError> Open(const char *path);
+
+            [[nodiscard]] inline std::string_view View() const { return {data, size}; }
+
+        private:
+            void swap(MappedFile &other) noexcept {
+                std::swap(data, other.data);
+                std::swap(size, other.size);
+#if !FLAGCXX_HAS_MMAP
+                std::swap(buffer, other.buffer);
+#endif
+            }
+
+            const char *data{nullptr};
+            std::size_t size{0};
+#if !FLAGCXX_HAS_MMAP
+            std::unique_ptr<char[]> buffer{};
+#endif
+        };
+
+        inline bool IsSpace(char c) {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+        }
+
+        /// @returns text without leading and trailing whitespace.
+        inline std::string_view Trim(std::string_view text) {
+            while (!text.empty() && IsSpace(text.front())) {
+                text.remove_prefix(1);
+            }
+            while (!text.empty() && IsSpace(text.back())) {
+                text.remove_suffix(1);
+            }
+            return text;
+        }
+
+        /// Splits response file content on whitespace into views of the content.
+        /// A token starting with a quote runs to the matching quote, which is left out.
+        template<typename Tokens>
+        void SplitResponseFile(std::string_view content, Tokens &tokens) {
+            std::size_t i = 0;
+            while (i < content.size()) {
+                while (i < content.size() && IsSpace(content[i])) {
+                    ++i;
+                }
+                if (i == content.size()) {
+                    break;
+                }
+                if (content[i] == '"' || content[i] == '\'') {
+                    auto close = content.find(content[i], i + 1);
+                    if (close == std::string_view::npos) {
+                        close = content.size();
+                    }
+                    tokens.push_back(content.substr(i + 1, close - i - 1));
+                    i = close + 1;
+                } else {
+                    auto start = i;
+                    while (i < content.size() && !IsSpace(content[i])) {
+                        ++i;
+                    }
+                    tokens.push_back(content.substr(start, i - start));
+                }
+            }
+        }
+
+        /// @returns whether any of the count arguments at args, before a -- terminator, is an
+        /// @file response file.
+        template<typename It>
+        bool HasResponseFile(It args, int count) {
+            for (; count > 0; --count, ++args) {
+                std::string_view arg{*args};
+                if (arg.size() > 1 && arg[0] == '@') {
+                    return true;
+                }
+                if (arg == "--") {
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        /// Flag records packed into contiguous tables, used as FlagSet's storage when
+        /// FLAGCXX_FLAT_STORAGE is set. Names are copied into one string pool and records kept in
+        /// one array in registration order. The index is an open-addressing table of 8-byte
+        /// entries, so 16 flags are found within four cache lines, and a lookup touches the
+        /// pool and the record array only for its match.
+        class FlatFlagTable {
+        public:
+            explicit FlatFlagTable(Allocator allocator = DefaultAllocator())
+                : index(allocator), pool(allocator), offsets(allocator), records(allocator) {}
+
+            /// Adds a flag, keeping the first one registered under a name.
+            FLAGCXX_INLINE void Insert(std::string_view name, Flag flag);
+
+            /// @returns the flag registered under name, nullptr if there is none.
+            [[nodiscard]] inline Flag *Find(std::string_view name) { return lookup(name, Hash(name)); }
+
+            /// Sizes the tables for count flags.
+            FLAGCXX_INLINE void Reserve(std::size_t count);
+
+            [[nodiscard]] inline std::size_t Size() const { return records.size(); }
+            [[nodiscard]] inline std::string_view Name(std::size_t i) const {
+                auto end = i + 1 < offsets.size() ? offsets[i + 1] : pool.size();
+                return std::string_view(pool).substr(offsets[i], end - offsets[i]);
+            }
+            [[nodiscard]] inline const Flag &Record(std::size_t i) const { return records[i]; }
+            [[nodiscard]] inline Flag &Record(std::size_t i) { return records[i]; }
+
+            /// FNV-1a, which is cheap for short names.
+            static std::uint32_t Hash(std::string_view name) {
+                std::uint32_t hash = 2166136261u;
+                for (auto c: name) {
+                    hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+                }
+                return hash;
+            }
+
+        private:
+            struct Entry {
+                std::uint32_t hash;
+                std::uint32_t record;// One past the record's position, 0 for an empty entry.
+            };
+
+            Flag *lookup(std::string_view name, std::uint32_t hash) {
+                if (index.empty()) {
+                    return nullptr;
+                }
+                auto mask = index.size() - 1;
+                for (auto i = hash & mask;; i = (i + 1) & mask) {
+                    const auto &entry = index[i];
+                    if (entry.record == 0) {
+                        return nullptr;
+                    }
+                    if (entry.hash == hash && Name(entry.record - 1) == name) {
+                        return &records[entry.record - 1];
+                    }
+                }
+            }
+
+            FLAGCXX_INLINE void place(std::uint32_t hash, std::uint32_t record);
+
+            FLAGCXX_INLINE void grow();
+
+            Vector<Entry> index;
+            String pool;
+            Vector<std::uint32_t> offsets;
+            Vector<Flag> records;
+        };
+
+        /// A radix tree over sorted flag names, for the lookups a hash table cannot do: finding
+        /// the only name with a given prefix, and the closest names to a misspelling. Each node
+        /// covers a range of the sorted names and the characters [start, end) they all share,
+        /// and its children are stored contiguously, in name order.
+        class NameIndex {
+        public:
+            explicit NameIndex(Allocator allocator = DefaultAllocator()) : names(allocator), nodes(allocator) {}
+
+            /// Indexes names, which must outlive the index.
+            FLAGCXX_INLINE void Build(Vector<std::string_view> indexed);
+
+            /// @returns the only indexed name starting with prefix, empty if there is none or
+            /// if several names do.
+            [[nodiscard]] FLAGCXX_INLINE std::string_view UniquePrefix(std::string_view prefix) const;
+
+            /// @returns the indexed name with the smallest edit distance to query, at most
+            /// maxDistance, and the first in name order of equally close ones. Empty if none is
+            /// close enough. Subtrees are skipped once every prefix they share is too far.
+            [[nodiscard]] FLAGCXX_INLINE std::string_view Closest(std::string_view query, std::size_t maxDistance) const;
+
+        private:
+            struct Node {
+                std::uint32_t lo, hi;    // The range of names below the node.
+                std::uint32_t start, end;// The characters all of them share.
+                std::uint32_t first{0}, count{0};
+            };
+
+            struct Search {
+                std::string_view query;
+                std::uint32_t *rows;
+                std::size_t width;
+                std::uint32_t bound;// The distance to beat.
+                std::string_view best;
+            };
+
+            FLAGCXX_INLINE Node node(std::uint32_t lo, std::uint32_t hi, std::uint32_t start);
+
+            FLAGCXX_INLINE void visit(const Node &at, Search &search) const;
+
+            Vector<std::string_view> names;
+            Vector<Node> nodes;
+            std::size_t depth{0};
+        };
+    }// namespace detail
+
+    /// One command line argument, classified without looking up any flag.
+    struct Token {
+        enum class Kind : std::uint8_t {
+            Flag,      // -name or --name, optionally followed by =value.
+            Terminator,// --, which ends the flags.
+            Positional,// Anything not starting with '-', including a lone '-'.
+            BadSyntax, // Starts with --- or -=.
+        };
+
+        std::string_view arg{};  // The whole argument.
+        std::uint32_t index{0};  // The argument's position in argv.
+        std::uint32_t nameEnd{0};// For flags, the offset of the '=' or the end of the argument.
+        std::uint8_t dashes{0};  // For flags, the number of leading dashes.
+        Kind kind{Kind::Positional};
+
+        /// @returns the flag name, without dashes or value.
+        [[nodiscard]] constexpr std::string_view Name() const { return arg.substr(dashes, nameEnd - dashes); }
+
+        /// @returns whether the flag was written as name=value.
+        [[nodiscard]] constexpr bool HasValue() const { return kind == Kind::Flag && nameEnd < arg.size(); }
+
+        /// @returns the value written after the '=', if there is one.
+        [[nodiscard]] constexpr std::string_view Value() const { return HasValue() ? arg.substr(nameEnd + 1) : std::string_view{}; }
+    };
+
+    /// Classifies a single argument.
+    inline Token Classify(std::string_view arg, std::uint32_t index) {
+        Token token{arg, index};
+        if (arg.size() < 2 || arg[0] != '-') {
+            token.kind = Token::Kind::Positional;
+            return token;
+        }
+        token.dashes = arg[1] == '-' ? 2 : 1;
+        if (token.dashes == 2 && arg.size() == 2) {
+            token.kind = Token::Kind::Terminator;
+            return token;
+        }
+        if (arg.size() == token.dashes || arg[token.dashes] == '-' || arg[token.dashes] == '=') {
+            token.kind = Token::Kind::BadSyntax;
+            token.nameEnd = static_cast<std::uint32_t>(arg.size());
+            return token;
+        }
+        // find() is a memchr, which stops at the first '=' and leaves long values unscanned.
+        auto equals = arg.find('=', token.dashes + 1);
+        token.nameEnd = static_cast<std::uint32_t>(equals == std::string_view::npos ? arg.size() : equals);
+        token.kind = Token::Kind::Flag;
+        return token;
+    }
+
+    /// Classifies every argument after the program name, for tools that only need to inspect
+    /// a command line. Which arguments are taken as values of the flags before them depends on
+    /// the flags' types, and is only decided when parsing.
+    template<typename It>
+    void Tokenize(int argc, It argv, std::vector<Token> &tokens) {
+        tokens.reserve(tokens.size() + static_cast<std::size_t>(argc > 1 ? argc - 1 : 0));
+        for (int i = 1; i < argc; ++i) {
+            tokens.push_back(Classify(argv[i], static_cast<std::uint32_t>(i)));
+        }
+    }
+
+    [[nodiscard]] inline std::vector<Token> Tokenize(int argc, const char **argv) {
+        std::vector<Token> tokens;
+        Tokenize(argc, argv, tokens);
+        return tokens;
+    }
+
+    class FlagSet;
+
+    /// A flag set by Parse, reported to a parse observer.
+    struct FlagEvent {
+        const FlagSet *flags;// The FlagSet holding the flag, a subcommand's for subcommand flags.
+        std::uint32_t id;    // The flag's position in that FlagSet, in registration order.
+        std::string_view name;
+        std::string_view value;
+        std::chrono::nanoseconds duration;// Time spent converting and storing the value.
+    };
+
+    /// The default parse observer. Parse compiles every observer call out when given one.
+    /// Other observers have the same two methods, and are called on the parsing thread.
+    struct NullObserver {
+        void OnFlag(const FlagEvent &) {}
+        void OnError(const Error &) {}
+    };
+
+    namespace detail {
+        template<typename Observer>
+        constexpr bool IsObserved = !std::is_same_v<Observer, NullObserver>;
+    }
+
+    class FlagSchema;
+    class IncrementalParser;
+    class Counters;
+    class Registration;
+    namespace detail {
+        struct RegistrationLink;
+    }
+    FLAGCXX_INLINE FlagSet &Registered();
+
+    /// How FlagSet::Usage renders the flags.
+    enum class UsageFormat {
+        Text,// An aligned table, wrapped to 80 columns.
+        Json,// A machine-readable schema of the flags and subcommands.
+    };
+
+    class FlagSet {
+    public:
+        FlagSet() : FlagSet(detail::SchemaView{}, detail::DefaultAllocator()) {}
+
+        /// Creates a FlagSet whose flags are declared up front by a Schema.
+        /// Variables bound with Var to declared names are stored in a flat table indexed
+        /// by the schema instead of a map. The schema must outlive the FlagSet.
+        template<std::size_t N>
+        explicit FlagSet(const Schema<N> &schema) : FlagSet(schema.View(), detail::DefaultAllocator()) {}
+
+        /// Creates a FlagSet whose flags are declared up front by a FlagSchema.
+        /// The schema must outlive the FlagSet.
+        FLAGCXX_INLINE explicit FlagSet(const FlagSchema &schema);
+
+#if FLAGCXX_HAS_PMR
+        /// Creates a FlagSet whose internal tables, buffers and subcommand FlagSets are all
+        /// allocated from resource, which must outlive it. Other FlagSets allocate with the
+        /// global operator new. Owning copies made by Args, and error messages, still do.
+        explicit FlagSet(std::pmr::memory_resource *resource) : FlagSet(detail::SchemaView{}, resource) {}
+
+        template<std::size_t N>
+        FlagSet(const Schema<N> &schema, std::pmr::memory_resource *resource) : FlagSet(schema.View(), resource) {}
+
+        FLAGCXX_INLINE FlagSet(const FlagSchema &schema, std::pmr::memory_resource *resource);
+
+        /// @returns the memory resource the FlagSet allocates from.
+        [[nodiscard]] inline std::pmr::memory_resource *Resource() const { return positional.get_allocator().resource(); }
+#endif
+
+        /// Parses a command line.
+        /// Arguments of the form @path, before any -- terminator, are replaced by the
+        /// whitespace-separated arguments in the file at path. The file is memory-mapped and
+        /// kept mapped for the lifetime of the FlagSet, values refer to it without copies.
+        /// @returns an optional error if one occurred.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> Parse(int argc, const char **argv);
+
+        /// Parses arguments held in a forward range of string-like elements, such as a
+        /// std::vector<std::string> or a span of string_views, which need not be NUL-terminated.
+        /// The range holds only the arguments, without a program name, and error indexes count
+        /// from 0. Values and ArgsView refer to the elements, which must outlive them.
+        template<typename Range, typename = std::enable_if_t<std::is_convertible_v<
+                                         decltype(*std::begin(std::declval<const Range &>())), std::string_view>>>
+        [[nodiscard]] std::optional<Error> Parse(const Range &args);
+
+        /// Parses a command line as Parse(argc, argv) does, reporting each flag set, with the
+        /// time its conversion took, to observer.OnFlag and any error to observer.OnError.
+        /// Subcommand flags are reported too.
+        template<typename Observer>
+        [[nodiscard]] std::optional<Error> Parse(int argc, const char **argv, Observer &observer);
+
+        /// Parses a range as Parse(args) does, reporting to observer.
+        template<typename Range, typename Observer,
+                 typename = std::enable_if_t<std::is_convertible_v<
+                         decltype(*std::begin(std::declval<const Range &>())), std::string_view>>>
+        [[nodiscard]] std::optional<Error> Parse(const Range &args, Observer &observer);
+
+        /// Sets flags from the config file at path. Each line holds name = value, or only the
+        /// name of a boolean flag to set it. Names under a [section] line are prefixed with
+        /// "section.". Lines starting with # or ; are comments, whitespace around names and
+        /// values is ignored and a value may be quoted. The file is memory-mapped and scanned in
+        /// place; it stays mapped for the lifetime of the FlagSet and values refer to it.
+        /// Flags set by ParseEnv or Parse keep their values, whichever order these are called in.
+        /// @returns an optional error, with the file, line and column, if one occurred.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> ParseFile(const std::string &path);
+
+        /// Sets flags from the environment. A variable named prefix_NAME sets the flag whose
+        /// name, in upper case and with dashes written as underscores, is NAME. The environment
+        /// is scanned once, each variable is looked up among the flags. Flags already set by
+        /// Parse keep their command line values, and Parse overwrites values set here, replacing
+        /// the elements of list flags. Values set here likewise take precedence over ParseFile.
+        /// Values are views into the environment, which must not be modified while they are in
+        /// use.
+        /// @returns an optional error, naming the variable, if a value is invalid.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> ParseEnv(std::string_view prefix);
+
+        /// Sets flags from env, a null-terminated array of NAME=value strings, as ParseEnv(prefix)
+        /// does from the environment.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> ParseEnv(std::string_view prefix, const char *const *env);
+
+        /// @returns where the value of the flag called name came from, empty if there is no such
+        /// flag.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Source> SourceOf(std::string_view name) const;
+
+        /// Sets whether Parse expands @path response files, which it does by default.
+        inline void AllowResponseFiles(bool allow) { responseFiles = allow; }
+
+        /// Sets whether Parse accepts an unambiguous prefix of a flag's name, such as -verb for
+        /// -verbose, which it does not by default. Full names are always looked up first, and -h
+        /// and -help still ask for usage.
+        /// Subcommands inherit the setting.
+        inline void AllowPrefixes(bool allow) { prefixes = allow; }
+
+        /// @returns the defined flag name closest to name, within an edit distance of 1 for
+        /// names of up to 3 characters and 2 for longer ones, empty if there is none. Errors for
+        /// undefined flags carry it as their Suggestion.
+        [[nodiscard]] FLAGCXX_INLINE std::string_view Suggest(std::string_view name);
+
+        template<typename T>
+        inline void Var(T &var, std::string_view name, std::string_view usage);
+
+        template<typename T>
+        inline void Var(std::optional<T> &var, std::string_view name, std::string_view usage);
+
+        /// Binds a list flag. Each occurrence appends its comma-separated elements to var. The
+        /// first occurrence from a higher-precedence source drops those of lower sources.
+        /// With std::string_view elements, the elements are views into the arguments.
+        template<typename T, typename A>
+        inline void Var(std::vector<T, A> &var, std::string_view name, std::string_view usage);
+
+        /// Binds a flag whose argument is recorded by Parse and converted when first read.
+        template<typename T>
+        inline void Var(Lazy<T> &var, std::string_view name, std::string_view usage);
+
+        /// Binds a flag that Reload can change while other threads read it. T must own its
+        /// contents, so it cannot be std::string_view.
+        template<typename T>
+        inline void Var(Live<T> &var, std::string_view name, std::string_view usage);
+
+        /// Binds an arithmetic or bool flag that other threads may read while Parse or Reload
+        /// runs. Each value is converted first and then stored with a single release store.
+        template<typename T>
+        inline void Var(std::atomic<T> &var, std::string_view name, std::string_view usage);
+
+        /// Binds a flag whose values must satisfy constraint: a Range, a Pattern, or any other
+        /// small, trivially copyable object with a std::optional<FlagError> Check(const T &)
+        /// const method. The constraint is copied into the flag and checked in the setter as
+        /// each value is parsed, a value that fails it is an EType::BadValue error and is not
+        /// stored. List flags check each element.
+        template<typename T, typename Constraint>
+        inline void Var(T &var, std::string_view name, std::string_view usage, Constraint constraint);
+
+        template<typename T, typename Constraint>
+        inline void Var(std::optional<T> &var, std::string_view name, std::string_view usage, Constraint constraint);
+
+        template<typename T, typename A, typename Constraint>
+        inline void Var(std::vector<T, A> &var, std::string_view name, std::string_view usage, Constraint constraint);
+
+        /// Binds an enum flag, whose value is one of the names in names. A value that names no
+        /// enumerator is an EType::BadValue error listing them. names must outlive the FlagSet.
+        template<typename E, std::size_t N>
+        inline void Var(E &var, std::string_view name, std::string_view usage, const Enum<E, N> &names);
+
+        template<typename E, std::size_t N>
+        void Var(E &var, std::string_view name, std::string_view usage, const Enum<E, N> &&names) = delete;
+
+        /// Reparses the flags bound to a Live while other threads read them. parse(flags) runs
+        /// any of the Parse methods on this FlagSet, for example
+        /// [&](flag::FlagSet &f) { return f.ParseFile(path); }. Setters write fresh snapshots,
+        /// which are all published once parse succeeds and dropped if it fails. Flags bound to a
+        /// std::atomic are stored as they are parsed, even if parse later fails. Other flags are
+        /// left unchanged, as are the positional arguments. Sources layer as they do for the first
+        /// parse. Files mapped by parse are released when it returns, unless it chose a subcommand.
+        /// Reloads must not run concurrently with each other or with other calls on the FlagSet.
+        /// @returns the error from parse, if there was one.
+        template<typename ParseFn>
+        [[nodiscard]] std::optional<Error> Reload(ParseFn &&parse);
+
+        /// Converts the recorded arguments of every flag bound to a Lazy, so that invalid
+        /// values are reported up front rather than when they are read.
+        /// @returns the first conversion error, if there was one.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> Validate();
+
+        /// Returns whether a command line has been parsed.
+        [[nodiscard]] inline bool Parsed() const { return parsed; }
+
+        /// @returns owning copies of the arguments remaining after the last flag parsing.
+        /// The copies are made on the first call, so the parsed argv must still be alive then.
+        [[nodiscard]] FLAGCXX_INLINE const std::vector<std::string> &Args() const;
+
+        /// @returns the arguments remaining after flag parsing as views into the parsed argv,
+        /// without copying them. The argv strings must outlive the FlagSet.
+        [[nodiscard]] inline Span<const std::string_view> ArgsView() const { return positional; }
+
+        /// @returns the values and sources of all flags as a compact binary snapshot, keyed by a
+        /// hash of the flags' names and types in the order they were bound. Values are stored
+        /// in native byte order.
+        [[nodiscard]] FLAGCXX_INLINE std::string SaveSnapshot();
+
+        /// Applies a snapshot made by SaveSnapshot, setting each flag's value and source
+        /// without parsing any text. String views refer into snapshot, which must outlive them.
+        /// @returns an error, and applies nothing, if snapshot was saved from flags with other
+        /// names or types, bound in another order, or by another version; or if it is
+        /// malformed, which may leave it partly applied.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> LoadSnapshot(std::string_view snapshot);
+
+        /// Maps the snapshot file at path and applies it as LoadSnapshot does. The file stays
+        /// mapped for the lifetime of the FlagSet.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> LoadSnapshotFile(const std::string &path);
+
+        /// @returns the usage of every flag and subcommand, sorted by name. The text is rendered
+        /// into one buffer on the first call and cached until flags or subcommands are added.
+        [[nodiscard]] FLAGCXX_INLINE std::string_view Usage(UsageFormat format = UsageFormat::Text);
+
+        /// Writes Usage(format) to the file descriptor fd, in a single write where the
+        /// descriptor accepts it all at once. Call it when Parse returns an EType::Help error.
+        /// @returns false if writing failed.
+        FLAGCXX_INLINE bool PrintUsage(int fd = 2, UsageFormat format = UsageFormat::Text);
+
+        /// Passes Usage(format) to sink(std::string_view) in a single call.
+        template<typename Sink, typename = std::enable_if_t<std::is_invocable_v<Sink &, std::string_view>>>
+        inline void PrintUsage(Sink &&sink, UsageFormat format = UsageFormat::Text) {
+            sink(Usage(format));
+        }
+
+        /// Constructs a subcommand's FlagSet, binding its flags.
+        using CommandFn = detail::InplaceFunction<void(FlagSet &)>;
+
+        /// Registers a subcommand. Once Parse reaches the end of this FlagSet's flags, the next
+        /// argument names the subcommand, and the remaining arguments are parsed by a child
+        /// FlagSet that factory(child) populates. The factory only runs for the chosen
+        /// subcommand. With subcommands registered, arguments after the flags must start with
+        /// one, unless they follow a -- terminator.
+        template<typename Factory>
+        inline void Subcommand(std::string_view name, std::string_view usage, Factory factory);
+
+        /// @returns the name of the subcommand chosen by Parse, empty if none was.
+        [[nodiscard]] inline std::string_view Chosen() const { return chosen; }
+
+        /// @returns the FlagSet of the subcommand chosen by Parse, nullptr if none was. Its Args
+        /// hold the arguments after the subcommand's flags.
+        [[nodiscard]] inline FlagSet *Child() const { return child.get(); }
+
+    private:
+        friend class IncrementalParser;
+        friend class Counters;
+        friend FlagSet &Registered();
+
+        FLAGCXX_INLINE FlagSet(detail::SchemaView view, detail::Allocator allocator);
+
+        [[nodiscard]] inline detail::Allocator allocator() const { return positional.get_allocator(); }
+
+        /// Destroys and frees a subcommand FlagSet allocated from its parent's allocator.
+        struct ChildDeleter {
+            detail::Allocator allocator;
+            FLAGCXX_INLINE void operator()(FlagSet *child) const;
+        };
+
+        template<typename It, typename Observer>
+        inline std::optional<Error> parse(It args, int count, int base, Observer *observer);
+
+        /// Parses arguments whose response files have been expanded.
+        template<typename It, typename Observer>
+        inline std::optional<Error> parseExpanded(It args, int count, int base, Observer *observer);
+
+        /// Appends argv to expanded with @path arguments replaced by the file's arguments, and
+        /// the argv index each came from to origins. At depth 0 argv starts at index origin,
+        /// deeper every argument came from the @path argument at origin.
+        template<typename It>
+        inline std::optional<Error> expandResponseFiles(int argc, It argv, detail::Vector<std::string_view> &expanded,
+                                                        detail::Vector<int> &origins, bool &terminated, int depth,
+                                                        int origin);
+
+        /// Sets flag from source, unless a source that takes precedence has already set it.
+        static FLAGCXX_INLINE std::optional<FlagError> setFrom(Flag &flag, Source source, std::string_view value);
+
+        FLAGCXX_INLINE void add(std::string_view name, Flag flag);
+        [[nodiscard]] FLAGCXX_INLINE Flag *find(std::string_view name);
+        FLAGCXX_INLINE void reserve(std::size_t count);
+
+        /// Calls fn(name, flag) for every flag.
+        template<typename Fn>
+        inline void forEach(Fn &&fn);
+
+        /// Collects every flag in registration order, schema flags first.
+        /// @returns the hash of their names and snapshot types.
+        FLAGCXX_INLINE std::uint64_t snapshotLayout(detail::Vector<std::pair<std::string_view, Flag *>> &ordered);
+
+        FLAGCXX_INLINE void renderUsage(UsageFormat format, detail::String &out);
+
+        /// @returns the index of flag names, built on first use after flags are added.
+        FLAGCXX_INLINE const detail::NameIndex &nameIndex();
+
+        /// Adds a suggestion to an UndefinedFlag error.
+        FLAGCXX_INLINE Error suggest(Error error);
+
+        bool parsed{false};
+        bool responseFiles{true};
+        bool prefixes{false};
+
+        detail::Vector<std::string_view> positional;
+        mutable std::vector<std::string> args{};
+#if FLAGCXX_FLAT_STORAGE
+        detail::FlatFlagTable flags;
+#else
+        detail::HashMap<std::string_view, Flag> flags;
+#endif
+
+        detail::SchemaView schema{};
+        detail::Vector<Flag> slots;
+
+        detail::Vector<detail::MappedFile> files;
+
+        struct Command {
+            std::string_view name;
+            std::string_view usage;
+            CommandFn factory;
+        };
+        detail::Vector<Command> commands;
+        std::string_view chosen{};
+        std::unique_ptr<FlagSet, ChildDeleter> child;
+
+        /// Rendered usage, by format, empty until rendered.
+        std::array<detail::String, 2> usageCache;
+
+        detail::NameIndex nameTree;
+        bool nameTreeBuilt{false};
+    };
+
+    template<typename Fn>
+    void FlagSet::forEach(Fn &&fn) {
+        for (std::size_t i = 0; i < slots.size(); ++i) {
+            fn(schema.specs[i].name, slots[i]);
+        }
+#if FLAGCXX_FLAT_STORAGE
+        for (std::size_t i = 0; i < flags.Size(); ++i) {
+            fn(flags.Name(i), flags.Record(i));
+        }
+#else
+        for (auto &[name, flag]: flags) {
+            fn(name, flag);
+        }
+#endif
+    }
+
+    /// A parse observer that counts how often each flag of one FlagSet is set, and each type of
+    /// error, with one relaxed atomic counter each. Several threads may parse with it at once.
+    class Counters {
+    public:
+        /// Counts the flags of flags, which must outlive the Counters. Flags bound later, and
+        /// subcommand flags, are not counted.
+        FLAGCXX_INLINE explicit Counters(FlagSet &flags);
+
+        inline void OnFlag(const FlagEvent &event) {
+            if (event.flags == owner && event.id < names.size()) {
+                hits[event.id].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        inline void OnError(const Error &error) {
+            errors[static_cast<std::size_t>(error.Type())].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /// @returns how often the flag called name was set, 0 if it is not counted.
+        [[nodiscard]] inline std::uint64_t Hits(std::string_view name) const {
+            auto found = std::find(names.begin(), names.end(), name);
+            return found == names.end() ? 0 : hits[static_cast<std::size_t>(found - names.begin())].load(std::memory_order_relaxed);
+        }
+
+        /// @returns how many errors of type were reported.
+        [[nodiscard]] inline std::uint64_t Errors(Error::EType type) const {
+            return errors[static_cast<std::size_t>(type)].load(std::memory_order_relaxed);
+        }
+
+        /// @returns a table with one "name<TAB>hits" line per flag, in registration order.
+        [[nodiscard]] FLAGCXX_INLINE std::string Table() const;
+
+    private:
+        static constexpr std::size_t errorTypes = static_cast<std::size_t>(Error::EType::BadSnapshot) + 1;
+
+        const FlagSet *owner;
+        std::vector<std::string_view> names{};// Indexed by flag id.
+        std::unique_ptr<std::atomic<std::uint64_t>[]> hits{};
+        std::array<std::atomic<std::uint64_t>, errorTypes> errors{};
+    };
+
+    namespace detail {
+        template<typename Views, typename It>
+        void AppendViews(Views &views, It args, int count) {
+            views.reserve(views.size() + static_cast<std::size_t>(count));
+            for (; count > 0; --count, ++args) {
+                views.emplace_back(*args);
+            }
+        }
+
+        /// The second parse stage: applies classified tokens to flags one at a time.
+        /// find(name) returns something pointer-like to a Flag, empty when the name is undefined.
+        /// Flags set are reported to observer, if Observer is not NullObserver.
+        template<typename Find, typename Observer = NullObserver>
+        class TokenParser {
+        public:
+            enum class State {
+                Flags,     // Still parsing flags.
+                Positional,// The last token was the first positional argument.
+                Terminated,// The last token was --, positional arguments follow it.
+            };
+
+            explicit TokenParser(Find &find, const FlagSet *flags = nullptr, Observer *observer = nullptr)
+                : find(find), flags(flags), observer(observer) {}
+
+            [[nodiscard]] inline State Current() const { return state; }
+
+            /// Applies one token. Tokens after the flags end must not be fed.
+            /// @returns an error if the token could not be applied.
+            [[nodiscard]] std::optional<Error> Feed(const Token &token) {
+                if (waiting) {
+                    // The previous flag takes this whole argument as its value.
+                    waiting = false;
+                    return apply(*pending, false, pendingName, token.arg, pendingIndex);
+                }
+
+                switch (token.kind) {
+                    case Token::Kind::Positional:
+                        state = State::Positional;
+                        return {};
+                    case Token::Kind::Terminator:
+                        state = State::Terminated;
+                        return {};
+                    case Token::Kind::BadSyntax:
+                        return Error(Error::EType::BadSyntax, static_cast<int>(token.index), token.Name());
+                    case Token::Kind::Flag:
+                        break;
+                }
+
+                auto name = token.Name();
+                auto index = static_cast<int>(token.index);
+                auto flag = find(name);
+                if (!flag) {
+                    if (name == "help" || name == "h") {
+                        // Special case for usage.
+                        return Error(Error::EType::Help, index, name);
+                    }
+                    return Error(Error::EType::UndefinedFlag, index, name);
+                }
+
+                if (flag->isBool) {
+                    return apply(*flag, true, name, token.HasValue() ? token.Value() : std::string_view{}, index);
+                }
+                if (token.HasValue()) {
+                    return apply(*flag, false, name, token.Value(), index);
+                }
+                pending = std::move(flag);
+                waiting = true;
+                pendingName = name;
+                pendingIndex = index;
+                return {};
+            }
+
+            /// Ends the arguments.
+            /// @returns an error if the last flag is still waiting for its value.
+            [[nodiscard]] std::optional<Error> Finish() {
+                if (waiting) {
+                    waiting = false;
+                    return Error(Error::EType::MissingValue, pendingIndex, pendingName);
+                }
+                return {};
+            }
+
+        private:
+            using FlagRef = decltype(std::declval<Find &>()(std::string_view{}));
+
+            std::optional<Error> apply(Flag &flag, bool isBool, std::string_view name, std::string_view value, int index) {
+                if (!flag.setFn) {
+                    // Declared in the schema but never bound, accept and ignore it.
+                    return {};
+                }
+                auto input = isBool && value.empty() ? std::string_view{"true"} : value;
+                Supersede(flag, Source::CommandLine);
+                std::optional<FlagError> err{};
+                if constexpr (IsObserved<Observer>) {
+                    auto start = std::chrono::steady_clock::now();
+                    err = flag.setFn(input);
+                    auto duration = std::chrono::steady_clock::now() - start;
+                    if (!err) {
+                        observer->OnFlag(FlagEvent{flags, flag.id, name, input,
+                                                   std::chrono::duration_cast<std::chrono::nanoseconds>(duration)});
+                    }
+                } else {
+                    err = flag.setFn(input);
+                }
+                if (err) {
+                    return Error(Error::EType::BadValue, index, name, value, std::move(err), isBool);
+                }
+                flag.source = Source::CommandLine;
+                return {};
+            }
+
+            Find &find;
+            const FlagSet *flags;
+            Observer *observer;
+            State state{State::Flags};
+            // The flag waiting for the next argument as its value, when waiting is set. Kept apart
+            // from an optional so that the compiler can see it is written before it is read.
+            FlagRef pending{};
+            bool waiting{false};
+            std::string_view pendingName{};
+            int pendingIndex{-1};
+        };
+
+        /// Parses arguments, shared by FlagSet and FlagSchema.
+        /// args is a forward iterator over count string-like arguments, such as C strings,
+        /// std::strings or string_views, and base is the index reported for the first of them.
+        /// Arguments are classified a chunk at a time into a token array on the stack, and the
+        /// chunk is then applied by a TokenParser. positional(first, count, terminated) receives
+        /// the tail of the arguments left after the flags, and whether a -- ended them.
+        template<typename It, typename Find, typename Positional, typename Observer = NullObserver>
+        std::optional<Error> ParseArgs(It args, int count, int base, Find &&find, Positional &&positional,
+                                       const FlagSet *flags = nullptr, Observer *observer = nullptr) {
+            constexpr int chunkSize = 16;
+            std::array<Token, chunkSize> chunk;
+            TokenParser<Find, Observer> parser{find, flags, observer};
+
+            for (int i = 0; i < count; i += chunkSize) {
+                auto size = std::min(chunkSize, count - i);
+                auto begin = args;
+                for (int k = 0; k < size; ++k, ++args) {
+                    chunk[k] = Classify(std::string_view{*args}, static_cast<std::uint32_t>(base + i + k));
+                }
+                for (int k = 0; k < size; ++k) {
+                    if (auto error = parser.Feed(chunk[k])) {
+                        return error;
+                    }
+                    if (parser.Current() != TokenParser<Find, Observer>::State::Flags) {
+                        auto terminated = parser.Current() == TokenParser<Find, Observer>::State::Terminated;
+                        auto skip = k + (terminated ? 1 : 0);
+                        positional(std::next(begin, skip), count - i - skip, terminated);
+                        return {};
+                    }
+                }
+            }
+            if (auto error = parser.Finish()) {
+                return error;
+            }
+            positional(args, 0, false);
+            return {};
+        }
+
+        /// Parses an argv of argc strings, whose first is the program name.
+        template<typename It, typename Find, typename Positional>
+        std::optional<Error> ParseArgv(int argc, It argv, Find &&find, Positional &&positional) {
+            if (argc < 1) {
+                return Error(Error::EType::NumArgs, -1);
+            }
+            return ParseArgs(std::next(argv), argc - 1, 1, find, positional);
+        }
+    }// namespace detail
+
+    /// Parses a command line that arrives a piece at a time, such as over a socket, into a
+    /// FlagSet. Whole tokens are fed with Feed, or bytes with FeedBytes, in which tokens end at
+    /// a separator and may be split across chunks. A flag and its value may arrive in separate
+    /// tokens and chunks. Bytes are copied into blocks owned by the parser, once each except
+    /// for the buffered start of a token that crosses a block boundary, which moves again into
+    /// the larger next block. The parser must outlive string_view flags and the views returned
+    /// by Args. Response files are not expanded. Error indexes count tokens from 0.
+    class IncrementalParser {
+    public:
+        explicit IncrementalParser(FlagSet &flags, char separator = '\0') : find{&flags}, separator(separator) {
+            flags.parsed = true;
+        }
+        IncrementalParser(const IncrementalParser &) = delete;
+        IncrementalParser &operator=(const IncrementalParser &) = delete;
+
+        /// Feeds one whole token.
+        /// @returns an error if the token could not be applied, and the same error after one.
+        [[nodiscard]] inline std::optional<Error> Feed(std::string_view token) {
+            if (failed) {
+                return failed;
+            }
+            append(token);
+            return complete();
+        }
+
+        /// Feeds a chunk of bytes, completing each token that ends at a separator in the chunk.
+        /// @returns an error if a token could not be applied, and the same error after one.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> FeedBytes(std::string_view bytes);
+
+        /// Ends the input. A token left unfinished by FeedBytes is complete.
+        /// @returns an error if a flag is still waiting for its value.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> Finish();
+
+        /// @returns the arguments after the flags.
+        [[nodiscard]] inline Span<const std::string_view> Args() const { return positional; }
+
+    private:
+        struct Find {
+            FlagSet *flags;
+            Flag *operator()(std::string_view name) const { return flags->find(name); }
+        };
+
+        /// Copies bytes onto the end of the partial token, moving the partial token into a new,
+        /// larger block if they do not fit in the current one.
+        FLAGCXX_INLINE void append(std::string_view bytes);
+        FLAGCXX_INLINE std::optional<Error> complete();
+
+        static constexpr std::size_t minBlock = 4096;
+
+        Find find;
+        detail::TokenParser<Find> parser{find};
+        char separator;
+        std::uint32_t index{0};
+        bool inFlags{true};
+        std::optional<Error> failed{};
+
+        std::vector<std::unique_ptr<char[]>> blocks{};
+        char *partial{nullptr};// The start of the token being buffered, in the last block.
+        std::size_t used{0};   // Bytes used in the last block.
+        std::size_t capacity{0};
+        bool buffering{false};
+        std::vector<std::string_view> positional{};
+    };
+
+    template<typename Range, typename>
+    std::optional<Error> FlagSet::Parse(const Range &args) {
+        NullObserver observer;
+        return Parse(args, observer);
+    }
+
+    template<typename Observer>
+    std::optional<Error> FlagSet::Parse(int argc, const char **argv, Observer &observer) {
+        std::optional<Error> error{};
+        if (argc < 1) {
+            parsed = true;
+            error = Error(Error::EType::NumArgs, -1);
+        } else {
+            error = parse(argv + 1, argc - 1, 1, &observer);
+        }
+        if constexpr (detail::IsObserved<Observer>) {
+            if (error) {
+                observer.OnError(*error);
+            }
+        }
+        return error;
+    }
+
+    template<typename Range, typename Observer, typename>
+    std::optional<Error> FlagSet::Parse(const Range &args, Observer &observer) {
+        using std::begin;
+        using std::end;
+        auto first = begin(args);
+        auto error = parse(first, static_cast<int>(std::distance(first, end(args))), 0, &observer);
+        if constexpr (detail::IsObserved<Observer>) {
+            if (error) {
+                observer.OnError(*error);
+            }
+        }
+        return error;
+    }
+
+    template<typename It, typename Observer>
+    std::optional<Error> FlagSet::parse(It args, int count, int base, Observer *observer) {
+        if (responseFiles && detail::HasResponseFile(args, count)) {
+            detail::Vector<std::string_view> expanded(allocator());
+            detail::Vector<int> origins(allocator());
+            expanded.reserve(static_cast<std::size_t>(count));
+            origins.reserve(static_cast<std::size_t>(count));
+            auto terminated = false;
+            if (auto error = expandResponseFiles(count, args, expanded, origins, terminated, 0, base)) {
+                parsed = true;
+                return error;
+            }
+            auto error = parseExpanded(expanded.data(), static_cast<int>(expanded.size()), base, observer);
+            // Report arguments read from a response file at the index of its @path argument.
+            if (error && error->Index() >= base && static_cast<std::size_t>(error->Index() - base) < origins.size()) {
+                error->Reindex(origins[static_cast<std::size_t>(error->Index() - base)]);
+            }
+            return error;
+        }
+        return parseExpanded(args, count, base, observer);
+    }
+
+    template<typename It, typename Observer>
+    std::optional<Error> FlagSet::parseExpanded(It args, int count, int base, Observer *observer) {
+        parsed = true;
+        positional.clear();
+        this->args.clear();
+        auto find = [this](std::string_view name) {
+            auto flag = this->find(name);
+            // help and h stay reserved for usage rather than abbreviating a flag.
+            if (flag == nullptr && prefixes && name != "help" && name != "h") {
+                auto full = nameIndex().UniquePrefix(name);
+                flag = full.empty() ? nullptr : this->find(full);
+            }
+            return flag;
+        };
+        std::optional<It> tail{};
+        int tailSize = 0;
+        bool tailTerminated = false;
+        auto keep = [&](It rest, int size, bool terminated) {
+            tail = rest;
+            tailSize = size;
+            tailTerminated = terminated;
+        };
+        chosen = {};
+        child.reset();
+        if (auto error = detail::ParseArgs(args, count, base, find, keep, this, observer)) {
+            return suggest(std::move(*error));
+        }
+        if (commands.empty() || tailSize == 0 || tailTerminated) {
+            detail::AppendViews(positional, *tail, tailSize);
+            return {};
+        }
+
+        // The first argument after the flags selects a subcommand, which parses the rest.
+        auto index = base + count - tailSize;
+        std::string_view name{**tail};
+        auto command = std::find_if(commands.begin(), commands.end(),
+                                    [name](const Command &command) { return command.name == name; });
+        if (command == commands.end()) {
+            return Error(Error::EType::UndefinedCommand, index, name);
+        }
+        chosen = command->name;
+        detail::Rebind<FlagSet> childAllocator(allocator());
+        auto memory = std::allocator_traits<detail::Rebind<FlagSet>>::allocate(childAllocator, 1);
+        child.reset(::new (static_cast<void *>(memory)) FlagSet(detail::SchemaView{}, allocator()));
+        child->responseFiles = false;
+        child->prefixes = prefixes;
+        command->factory(*child);
+        return child->parseExpanded(std::next(*tail), tailSize - 1, index + 1, observer);
+    }
+
+    template<typename Factory>
+    void FlagSet::Subcommand(std::string_view name, std::string_view usage, Factory factory) {
+        for (auto &cached: usageCache) {
+            cached.clear();
+        }
+        commands.push_back(Command{name, usage, CommandFn{factory}});
+    }
+
+    template<typename It>
+    std::optional<Error> FlagSet::expandResponseFiles(int argc, It argv, detail::Vector<std::string_view> &expanded,
+                                                      detail::Vector<int> &origins, bool &terminated, int depth,
+                                                      int origin) {
+        for (int i = 0; i < argc; ++i, ++argv) {
+            auto arg = std::string_view(*argv);
+            auto index = depth == 0 ? origin + i : origin;
+            if (terminated || arg.size() < 2 || arg[0] != '@') {
+                terminated = terminated || arg == "--";
+                expanded.push_back(arg);
+                origins.push_back(index);
+                continue;
+            }
+
+            auto path = arg.substr(1);
+            if (depth == 16) {
+                return Error(Error::EType::BadFile, index, path, {}, FlagError::Static("response files are nested too deeply"));
+            }
+            detail::MappedFile file;
+            if (auto err = file.Open(detail::String(path, allocator()).c_str())) {
+                return Error(Error::EType::BadFile, index, path, {}, std::move(err));
+            }
+            detail::Vector<std::string_view> tokens(allocator());
+            detail::SplitResponseFile(file.View(), tokens);
+            files.push_back(std::move(file));
+            if (auto error = expandResponseFiles(static_cast<int>(tokens.size()), tokens.data(), expanded, origins,
+                                                 terminated, depth + 1, index)) {
+                return error;
+            }
+        }
+        return {};
+    }
+
+    namespace detail {
+        /// Integer flag types: every integral type except bool and the character types.
+        template<typename T>
+        constexpr bool IsFlagInteger = std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+                                       !std::is_same_v<T, char> && !std::is_same_v<T, wchar_t> &&
+                                       !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>;
+
+        /// Parses an integer with an optional 0x, 0o or 0b base prefix after the sign.
+        template<typename T>
+        std::from_chars_result ParseInteger(const char *first, const char *last, T &value) {
+            auto p = first;
+            auto negative = false;
+            if constexpr (std::is_signed_v<T>) {
+                negative = p != last && *p == '-';
+                if (negative) {
+                    ++p;
+                }
+            }
+
+            auto base = 10;
+            if (last - p > 2 && p[0] == '0') {
+                switch (p[1]) {
+                    case 'x':
+                    case 'X':
+                        base = 16;
+                        break;
+                    case 'o':
+                    case 'O':
+                        base = 8;
+                        break;
+                    case 'b':
+                    case 'B':
+                        base = 2;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            if (base == 10) {
+                return std::from_chars(first, last, value);
+            }
+
+            // Parse the magnitude unsigned, then apply the sign with a range check.
+            using U = std::make_unsigned_t<T>;
+            U magnitude{};
+            auto result = std::from_chars(p + 2, last, magnitude, base);
+            if (result.ec != std::errc{}) {
+                return {first, result.ec};
+            }
+            constexpr auto max = static_cast<U>(std::numeric_limits<T>::max());
+            if (magnitude > max + (negative ? 1u : 0u)) {
+                return {first, std::errc::result_out_of_range};
+            }
+            value = negative ? static_cast<T>(U{0} - magnitude) : static_cast<T>(magnitude);
+            return result;
+        }
+
+        template<typename T, std::enable_if_t<IsFlagInteger<T>, int> = 0>
+        Flag::SetFn MakeSetFn(T &var) {
+            return [&var](std::string_view s) {
+                auto [ptr, ec] = ParseInteger(s.data(), s.data() + s.size(), var);
+                if (ec == std::errc::invalid_argument) {
+                    return std::optional<FlagError>{FlagError::Static("number is not an integer")};
+                }
+                if (ec == std::errc::result_out_of_range) {
+                    return std::optional<FlagError>{FlagError::Static("number is out of range")};
+                }
+                return std::optional<FlagError>{};
+            };
+        }
+
+#if FLAGCXX_HAS_STRTOD_L
+        /// @returns the C locale, created on first use and never freed, or null if it could not be.
+        inline locale_t CLocale() {
+            static const locale_t locale = newlocale(LC_NUMERIC_MASK, "C", locale_t{});
+            return locale;
+        }
+#endif
+
+        /// Converts a NUL terminated number with strtof, strtod or strtold, in the C locale where
+        /// strtod_l is available.
+        template<typename T>
+        T StrToFloat(const char *number) {
+#if FLAGCXX_HAS_STRTOD_L
+            if (auto locale = CLocale()) {
+                if constexpr (std::is_same_v<T, float>) {
+                    return strtof_l(number, nullptr, locale);
+                } else if constexpr (std::is_same_v<T, double>) {
+                    return strtod_l(number, nullptr, locale);
+                } else {
+                    return strtold_l(number, nullptr, locale);
+                }
+            }
+#endif
+            if constexpr (std::is_same_v<T, float>) {
+                return std::strtof(number, nullptr);
+            } else if constexpr (std::is_same_v<T, double>) {
+                return std::strtod(number, nullptr);
+            } else {
+                return std::strtold(number, nullptr);
+            }
+        }
+
+        /// Parses a floating point number without std::from_chars.
+        /// Numbers whose decimal significand and power of ten are exactly representable in
+        /// T take Clinger's fast path, which is a single correctly rounded multiply or divide.
+        /// Anything longer falls back to strtod on a copy of the digits, in the C locale
+        /// where strtod_l is available. Elsewhere the slow path follows LC_NUMERIC, so a
+        /// program that sets a locale with a decimal comma must keep LC_NUMERIC as "C".
+        template<typename T>
+        std::from_chars_result ParseFloatFallback(const char *first, const char *last, T &value) {
+            constexpr int maxDigits = 19;
+            constexpr int maxExactPow10 = std::numeric_limits<T>::digits > 24 ? 22 : 10;
+            constexpr std::uint64_t maxExactMantissa = std::numeric_limits<T>::digits >= 64
+                                                               ? std::numeric_limits<std::uint64_t>::max()
+                                                               : std::uint64_t{1} << std::numeric_limits<T>::digits;
+
+            auto p = first;
+            auto negative = p != last && *p == '-';
+            if (negative) {
+                ++p;
+            }
+
+            std::uint64_t mantissa = 0;
+            auto digits = 0;
+            auto exponent = 0;
+            auto truncated = false;
+            auto anyDigits = false;
+            auto digit = [&](char c, bool fraction) {
+                if (digits < maxDigits) {
+                    mantissa = mantissa * 10 + static_cast<std::uint64_t>(c - '0');
+                    if (mantissa != 0) {
+                        digits++;
+                    }
+                    if (fraction) {
+                        exponent--;
+                    }
+                } else {
+                    truncated = truncated || c != '0';
+                    if (!fraction) {
+                        exponent++;
+                    }
+                }
+                anyDigits = true;
+            };
+            for (; p != last && *p >= '0' && *p <= '9'; ++p) {
+                digit(*p, false);
+            }
+            if (p != last && *p == '.') {
+                for (++p; p != last && *p >= '0' && *p <= '9'; ++p) {
+                    digit(*p, true);
+                }
+            }
+            if (!anyDigits) {
+                return {first, std::errc::invalid_argument};
+            }
+            if (p != last && (*p == 'e' || *p == 'E')) {
+                auto e = p + 1;
+                auto negativeExponent = e != last && *e == '-';
+                if (e != last && (*e == '-' || *e == '+')) {
+                    ++e;
+                }
+                if (e != last && *e >= '0' && *e <= '9') {
+                    auto explicitExponent = 0;
+                    for (; e != last && *e >= '0' && *e <= '9'; ++e) {
+                        if (explicitExponent < 100000) {
+                            explicitExponent = explicitExponent * 10 + (*e - '0');
+                        }
+                    }
+                    exponent += negativeExponent ? -explicitExponent : explicitExponent;
+                    p = e;
+                }
+            }
+
+            if (!truncated && mantissa <= maxExactMantissa && exponent >= -maxExactPow10 && exponent <= maxExactPow10) {
+                auto result = static_cast<T>(mantissa);
+                T pow10 = 1;
+                for (auto i = 0; i < (exponent < 0 ? -exponent : exponent); ++i) {
+                    pow10 *= 10;
+                }
+                result = exponent < 0 ? result / pow10 : result * pow10;
+                value = negative ? -result : result;
+                return {p, std::errc{}};
+            }
+
+            // Slow path, the digits need a NUL terminated copy for strtod, on the stack unless
+            // the number is unusually long.
+            char buffer[128];
+            std::string longer{};
+            const char *number = buffer;
+            auto length = static_cast<std::size_t>(p - first);
+            if (length < sizeof(buffer)) {
+                std::copy(first, p, buffer);
+                buffer[length] = '\0';
+            } else {
+                longer.assign(first, p);
+                number = longer.c_str();
+            }
+            errno = 0;
+            auto result = StrToFloat<T>(number);
+            if (errno == ERANGE) {
+                return {first, std::errc::result_out_of_range};
+            }
+            value = result;
+            return {p, std::errc{}};
+        }
+
+        template<typename T>
+        std::from_chars_result ParseFloat(const char *first, const char *last, T &value) {
+            // Like the iostreams this replaces, accept an explicit leading plus sign.
+            if (last - first > 1 && *first == '+' && first[1] != '-') {
+                ++first;
+            }
+#if FLAGCXX_HAS_FLOAT_FROM_CHARS
+            return std::from_chars(first, last, value);
+#else
+            return ParseFloatFallback(first, last, value);
+#endif
+        }
+
+        template<typename T, std::size_t N>
+        Flag::SetFn MakeFloatSetFn(T &var, const char (&notANumber)[N]) {
+            return [&var, &notANumber](std::string_view s) {
+                auto [ptr, ec] = ParseFloat(s.data(), s.data() + s.size(), var);
+                if (ec == std::errc::invalid_argument) {
+                    return std::optional<FlagError>{FlagError::Static(notANumber)};
+                }
+                if (ec == std::errc::result_out_of_range) {
+                    return std::optional<FlagError>{FlagError::Static("number is out of range")};
+                }
+                return std::optional<FlagError>{};
+            };
+        }
+
+        template<typename T, std::enable_if_t<std::is_floating_point_v<T>, int> = 0>
+        Flag::SetFn MakeSetFn(T &var) {
+            if constexpr (std::is_same_v<T, float>) {
+                return MakeFloatSetFn(var, "number is not a float");
+            } else if constexpr (std::is_same_v<T, double>) {
+                return MakeFloatSetFn(var, "number is not a double");
+            } else {
+                return MakeFloatSetFn(var, "number is not a long double");
+            }
+        }
+
+        inline Flag::SetFn MakeSetFn(std::string &var) {
+            return [&](std::string_view s) {
+                var = s;
+                return std::optional<FlagError>{};
+            };
+        }
+
+#if FLAGCXX_HAS_PMR
+        /// Values are copied into the string's own memory resource.
+        inline Flag::SetFn MakeSetFn(std::pmr::string &var) {
+            return [&](std::string_view s) {
+                var = s;
+                return std::optional<FlagError>{};
+            };
+        }
+#endif
+
+        /// A view of the argument itself, which must outlive the variable.
+        inline Flag::SetFn MakeSetFn(std::string_view &var) {
+            return [&](std::string_view s) {
+                var = s;
+                return std::optional<FlagError>{};
+            };
+        }
+
+        inline Flag::SetFn MakeSetFn(bool &var) {
+            static constexpr std::array<std::string_view, 4> trueValues{"true", "t", "yes", "y"};
+            static constexpr std::array<std::string_view, 5> falseValues{"false", "f", "no", "n"};
+            return [&](std::string_view s) -> std::optional<FlagError> {
+                if (s.empty()) {
+                    var = true;
+                } else {
+                    if (std::find(trueValues.begin(), trueValues.end(), s) != trueValues.end()) {
+                        var = true;
+                    } else if (std::find(falseValues.begin(), falseValues.end(), s) != falseValues.end()) {
+                        var = false;
+                    } else {
+                        return FlagError::Static("Unknown boolean value");
+                    }
+                }
+                return {};
+            };
+        }
+
+        /// The constraint of flags bound without one, which accepts every value.
+        struct Unconstrained {
+            template<typename T>
+            std::optional<FlagError> Check(const T &) const { return {}; }
+        };
+
+        template<typename T, typename = void>
+        constexpr bool HasAllocator = false;
+        template<typename T>
+        constexpr bool HasAllocator<T, std::void_t<typename T::allocator_type>> = true;
+
+        /// Converts into a temporary, made with var's allocator if it has one, and stores it
+        /// in var if it satisfies constraint.
+        template<typename T, typename Constraint>
+        Flag::SetFn MakeCheckedSetFn(T &var, Constraint constraint) {
+            return [&var, constraint](std::string_view s) {
+                auto value = [&var] {
+                    if constexpr (HasAllocator<T>) {
+                        return T(var.get_allocator());
+                    } else {
+                        return T{};
+                    }
+                }();
+                if (auto err = MakeSetFn(value)(s)) {
+                    return err;
+                }
+                if (auto err = constraint.Check(value)) {
+                    return err;
+                }
+                var = std::move(value);
+                return std::optional<FlagError>{};
+            };
+        }
+
+        template<typename T, typename Constraint = Unconstrained>
+        Flag::SetFn MakeOptionalSetFn(std::optional<T>& var, Constraint constraint = {}) {
+            return [&var, constraint](std::string_view s) {
+                T tmp{};
+                auto err = MakeSetFn(tmp)(s);
+                if (!err) {
+                    err = constraint.Check(tmp);
+                }
+                if (err) {
+                    return err;
+                }
+                var = tmp;
+                return std::optional<FlagError>{};
+            };
+        }
+
+        /// Appends the comma-separated elements of every occurrence of the flag, converting
+        /// each element in place with the element type's setter. Elements that take an
+        /// allocator, such as std::pmr::string, are made with the vector's. Each element must
+        /// satisfy constraint, or the occurrence appends none.
+        template<typename T, typename A, typename Constraint = Unconstrained>
+        Flag::SetFn MakeVectorSetFn(std::vector<T, A> &var, Constraint constraint = {}) {
+            return [&var, constraint](std::string_view s) {
+                if (s.empty()) {
+                    return std::optional<FlagError>{};
+                }
+                auto size = var.size();
+                // Single elements leave growth to push_back. Larger occurrences reserve at most
+                // once, and geometrically, so that many occurrences do not reallocate each time.
+                auto needed = size + static_cast<std::size_t>(std::count(s.begin(), s.end(), ',')) + 1;
+                if (needed > size + 1 && needed > var.capacity()) {
+                    var.reserve(std::max(2 * var.capacity(), needed));
+                }
+                while (true) {
+                    auto comma = s.find(',');
+                    auto element = [&var] {
+                        if constexpr (std::uses_allocator_v<T, A>) {
+                            return T(var.get_allocator());
+                        } else {
+                            return T{};
+                        }
+                    }();
+                    auto err = MakeSetFn(element)(s.substr(0, comma));
+                    if (!err) {
+                        err = constraint.Check(element);
+                    }
+                    if (err) {
+                        var.resize(size);
+                        return err;
+                    }
+                    var.push_back(std::move(element));
+                    if (comma == std::string_view::npos) {
+                        break;
+                    }
+                    s.remove_prefix(comma + 1);
+                }
+                return std::optional<FlagError>{};
+            };
+        }
+
+        /// @returns a Flag::ResetFn that truncates var to the elements it holds now, its defaults.
+        template<typename T, typename A>
+        Flag::ResetFn MakeResetFn(std::vector<T, A> &var) {
+            return [&var, size = var.size()] {
+                if (var.size() > size) {
+                    var.erase(var.begin() + static_cast<std::ptrdiff_t>(size), var.end());
+                }
+            };
+        }
+    }// namespace detail
+
+    namespace detail {
+        template<typename T>
+        void AppendBytes(std::string &out, const T &value) {
+            out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+
+        template<typename T>
+        bool ReadBytes(std::string_view &in, T &value) {
+            if (in.size() < sizeof(T)) {
+                return false;
+            }
+            std::memcpy(&value, in.data(), sizeof(T));
+            in.remove_prefix(sizeof(T));
+            return true;
+        }
+
+        /// How a flag's value is laid out in a snapshot. tag identifies the type: its low byte
+        /// holds the size of arithmetic types, the next byte the kind (1 bool, 2 floating
+        /// point, 3 signed, 4 unsigned, 5 string, 6 enum), and the bits above any wrapper
+        /// (1 optional, 2 vector, 3 Lazy).
+        template<typename T, typename = void>
+        struct SnapshotTraits;
+
+        template<typename T>
+        struct SnapshotTraits<T, std::enable_if_t<std::is_arithmetic_v<T>>> {
+            static constexpr std::uint32_t tag = ((std::is_same_v<T, bool> ? 1u : std::is_floating_point_v<T> ? 2u : std::is_signed_v<T> ? 3u : 4u) << 8) | sizeof(T);
+            static void Save(std::string &out, const T &value) { AppendBytes(out, value); }
+            static bool Load(std::string_view &in, T &value) { return ReadBytes(in, value); }
+        };
+
+        /// Enums are stored as their underlying integer.
+        template<typename T>
+        struct SnapshotTraits<T, std::enable_if_t<std::is_enum_v<T>>> {
+            static constexpr std::uint32_t tag = (6u << 8) | sizeof(T);
+            static void Save(std::string &out, const T &value) { AppendBytes(out, value); }
+            static bool Load(std::string_view &in, T &value) { return ReadBytes(in, value); }
+        };
+
+        template<typename T>
+        struct SnapshotTraits<T, std::enable_if_t<std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>
+#if FLAGCXX_HAS_PMR
+                                                  || std::is_same_v<T, std::pmr::string>
+#endif
+                                                  >> {
+            static constexpr std::uint32_t tag = 5u << 8;
+            static void Save(std::string &out, const T &value) {
+                AppendBytes(out, static_cast<std::uint32_t>(value.size()));
+                out.append(value.data(), value.size());
+            }
+            static bool Load(std::string_view &in, T &value) {
+                std::uint32_t size{};
+                if (!ReadBytes(in, size) || in.size() < size) {
+                    return false;
+                }
+                if constexpr (std::is_same_v<T, std::string_view>) {
+                    value = in.substr(0, size);
+                } else {
+                    value.assign(in.data(), size);
+                }
+                in.remove_prefix(size);
+                return true;
+            }
+        };
+
+        template<typename T>
+        struct SnapshotTraits<std::optional<T>> {
+            static constexpr std::uint32_t tag = 0x10000u | SnapshotTraits<T>::tag;
+            static void Save(std::string &out, const std::optional<T> &value) {
+                out.push_back(value ? '\1' : '\0');
+                if (value) {
+                    SnapshotTraits<T>::Save(out, *value);
+                }
+            }
+            static bool Load(std::string_view &in, std::optional<T> &value) {
+                if (in.empty()) {
+                    return false;
+                }
+                auto present = in[0] != '\0';
+                in.remove_prefix(1);
+                if (!present) {
+                    value.reset();
+                    return true;
+                }
+                T loaded{};
+                if (!SnapshotTraits<T>::Load(in, loaded)) {
+                    return false;
+                }
+                value = std::move(loaded);
+                return true;
+            }
+        };
+
+        template<typename T, typename A>
+        struct SnapshotTraits<std::vector<T, A>> {
+            static constexpr std::uint32_t tag = 0x20000u | SnapshotTraits<T>::tag;
+            static void Save(std::string &out, const std::vector<T, A> &value) {
+                AppendBytes(out, static_cast<std::uint32_t>(value.size()));
+                for (const auto &element: value) {
+                    SnapshotTraits<T>::Save(out, element);
+                }
+            }
+            static bool Load(std::string_view &in, std::vector<T, A> &value) {
+                std::uint32_t size{};
+                if (!ReadBytes(in, size)) {
+                    return false;
+                }
+                // Every element takes at least a byte, which bounds what a bad size reserves.
+                std::vector<T, A> loaded(value.get_allocator());
+                loaded.reserve(std::min<std::size_t>(size, in.size()));
+                for (std::uint32_t i = 0; i < size; ++i) {
+                    T element{};
+                    if (!SnapshotTraits<T>::Load(in, element)) {
+                        return false;
+                    }
+                    loaded.push_back(std::move(element));
+                }
+                value = std::move(loaded);
+                return true;
+            }
+        };
+
+        /// Adds snapshot support to flag, which is bound to var.
+        template<typename T>
+        Flag WithSnapshot(Flag flag, T &var) {
+            flag.snapshotType = SnapshotTraits<T>::tag;
+            flag.snapshotFn = [&var](std::string *out, std::string_view *in) {
+                if (out != nullptr) {
+                    SnapshotTraits<T>::Save(*out, var);
+                    return true;
+                }
+                return SnapshotTraits<T>::Load(*in, var);
+            };
+            return flag;
+        }
+    }// namespace detail
+
+    template<typename T>
     void FlagSet::Var(T &var, std::string_view name, std::string_view usage) {
-        auto flag = Flag{detail::MakeSetFn(var), usage, false};
-        flags.insert({name, flag});
+        add(name, detail::WithSnapshot(Flag{detail::MakeSetFn(var), usage, false}, var));
     }
 
     template<typename T>
     void FlagSet::Var(std::optional<T> &var, std::string_view name, std::string_view usage) {
-        auto flag = Flag{detail::MakeOptionalSetFn(var), usage, false};
-        flags.insert({name, flag});
+        add(name, detail::WithSnapshot(Flag{detail::MakeOptionalSetFn(var), usage, false}, var));
+    }
+
+    template<typename T, typename A>
+    void FlagSet::Var(std::vector<T, A> &var, std::string_view name, std::string_view usage) {
+        auto flag = detail::WithSnapshot(Flag{detail::MakeVectorSetFn(var), usage, false}, var);
+        flag.resetFn = detail::MakeResetFn(var);
+        add(name, flag);
+    }
+
+    template<typename T, typename Constraint>
+    void FlagSet::Var(T &var, std::string_view name, std::string_view usage, Constraint constraint) {
+        add(name, detail::WithSnapshot(Flag{detail::MakeCheckedSetFn(var, constraint), usage, std::is_same_v<T, bool>}, var));
+    }
+
+    template<typename T, typename Constraint>
+    void FlagSet::Var(std::optional<T> &var, std::string_view name, std::string_view usage, Constraint constraint) {
+        add(name, detail::WithSnapshot(Flag{detail::MakeOptionalSetFn(var, constraint), usage, std::is_same_v<T, bool>}, var));
+    }
+
+    template<typename T, typename A, typename Constraint>
+    void FlagSet::Var(std::vector<T, A> &var, std::string_view name, std::string_view usage, Constraint constraint) {
+        auto flag = detail::WithSnapshot(Flag{detail::MakeVectorSetFn(var, constraint), usage, false}, var);
+        flag.resetFn = detail::MakeResetFn(var);
+        add(name, flag);
+    }
+
+    template<typename E, std::size_t N>
+    void FlagSet::Var(E &var, std::string_view name, std::string_view usage, const Enum<E, N> &names) {
+        auto flag = Flag{[&var, &names](std::string_view s) {
+                             auto value = names.Find(s);
+                             if (!value) {
+                                 return std::optional<FlagError>{names.Unknown()};
+                             }
+                             var = *value;
+                             return std::optional<FlagError>{};
+                         },
+                         usage};
+        add(name, detail::WithSnapshot(flag, var));
+    }
+
+    template<typename T>
+    void FlagSet::Var(Lazy<T> &var, std::string_view name, std::string_view usage) {
+        auto flag = Flag{[&var](std::string_view s) {
+                             var.raw = s;
+                             var.resolved = false;
+                             return std::optional<FlagError>{};
+                         },
+                         usage, std::is_same_v<T, bool>};
+        flag.resolveFn = [&var](std::string_view &raw) {
+            raw = var.Raw();
+            return var.Resolve();
+        };
+        // The recorded argument is saved, and converted once read after loading.
+        flag.snapshotType = 0x30000u | detail::SnapshotTraits<T>::tag;
+        flag.snapshotFn = [&var](std::string *out, std::string_view *in) {
+            using Traits = detail::SnapshotTraits<std::optional<std::string_view>>;
+            if (out != nullptr) {
+                Traits::Save(*out, var.raw);
+                return true;
+            }
+            bool loaded = Traits::Load(*in, var.raw);
+            if (var.raw) {
+                var.resolved = false;
+            } else {
+                // Unset in the snapshot: the default applies again, with nothing left to convert.
+                var.value = var.fallback;
+                var.error.reset();
+                var.resolved = true;
+            }
+            return loaded;
+        };
+        add(name, flag);
+    }
+
+    template<typename T>
+    std::optional<FlagError> Lazy<T>::Resolve() const {
+        if (!resolved) {
+            resolved = true;
+            if (raw) {
+                T converted{};
+                error = detail::MakeSetFn(converted)(*raw);
+                if (!error) {
+                    value = std::move(converted);
+                }
+            }
+        }
+        return error;
+    }
+
+    template<typename T>
+    void FlagSet::Var(Live<T> &var, std::string_view name, std::string_view usage) {
+        static_assert(!std::is_same_v<T, std::string_view>,
+                      "a Live value outlives the arguments of a Reload, bind a Live<std::string> instead");
+        auto flag = Flag{[&var](std::string_view s) { return detail::MakeSetFn(var.target())(s); },
+                         usage, std::is_same_v<T, bool>};
+        flag.liveFn = [&var](detail::LiveOp op) { var.apply(op); };
+        flag.snapshotType = detail::SnapshotTraits<T>::tag;
+        flag.snapshotFn = [&var](std::string *out, std::string_view *in) {
+            if (out != nullptr) {
+                detail::SnapshotTraits<T>::Save(*out, var.Get());
+                return true;
+            }
+            return detail::SnapshotTraits<T>::Load(*in, var.target());
+        };
+        add(name, flag);
+    }
+
+    template<typename T>
+    void FlagSet::Var(std::atomic<T> &var, std::string_view name, std::string_view usage) {
+        static_assert(std::is_arithmetic_v<T>, "atomic flags must be arithmetic or bool");
+        auto flag = Flag{[&var](std::string_view s) {
+                             T value{};
+                             auto err = detail::MakeSetFn(value)(s);
+                             if (!err) {
+                                 var.store(value, std::memory_order_release);
+                             }
+                             return err;
+                         },
+                         usage, std::is_same_v<T, bool>};
+        flag.liveFn = [](detail::LiveOp) {};
+        flag.snapshotType = detail::SnapshotTraits<T>::tag;
+        flag.snapshotFn = [&var](std::string *out, std::string_view *in) {
+            if (out != nullptr) {
+                detail::SnapshotTraits<T>::Save(*out, var.load(std::memory_order_acquire));
+                return true;
+            }
+            T value{};
+            if (!detail::SnapshotTraits<T>::Load(*in, value)) {
+                return false;
+            }
+            var.store(value, std::memory_order_release);
+            return true;
+        };
+        add(name, flag);
+    }
+
+    template<typename ParseFn>
+    std::optional<Error> FlagSet::Reload(ParseFn &&parse) {
+        // Other flags are unbound while parse runs, so that neither setters nor snapshots write
+        // their variables under their readers, and restored afterwards with their sources.
+        detail::Vector<std::pair<Flag *, Flag>> unbound(allocator());
+        // Nothing that outlives this call views the files parse maps, or the arguments it leaves,
+        // so both are released afterwards and repeated reloads do not accumulate them. An error
+        // copies what it refers to first.
+        auto mapped = files.size();
+        detail::Vector<std::string_view> kept(allocator());
+        kept.swap(positional);
+        forEach([&unbound](std::string_view, Flag &flag) {
+            if (flag.liveFn) {
+                flag.liveFn(detail::LiveOp::Stage);
+            } else {
+                unbound.emplace_back(&flag, flag);
+                flag.setFn = {};
+                flag.snapshotFn = {};
+                flag.resetFn = {};
+            }
+        });
+        std::optional<Error> error = parse(*this);
+        for (auto &[flag, saved]: unbound) {
+            *flag = saved;
+        }
+        positional.swap(kept);
+        args.clear();
+        if (error) {
+            error->Own();
+        }
+        if (chosen.empty()) {
+            files.erase(files.begin() + static_cast<std::ptrdiff_t>(mapped), files.end());
+        }
+        forEach([&error](std::string_view, Flag &flag) {
+            if (flag.liveFn) {
+                flag.liveFn(error ? detail::LiveOp::Discard : detail::LiveOp::Publish);
+            }
+        });
+        return error;
     }
 
     template<>
-    void FlagSet::Var(bool &var, std::string_view name, std::string_view usage) {
-        auto flag = Flag{detail::MakeSetFn(var), usage, true};
-        flags.insert({name, flag});
+    inline void FlagSet::Var(bool &var, std::string_view name, std::string_view usage) {
+        add(name, detail::WithSnapshot(Flag{detail::MakeSetFn(var), usage, true}, var));
     }
 
     template<>
-    void FlagSet::Var(std::optional<bool> &var, std::string_view name, std::string_view usage) {
-        auto flag = Flag{detail::MakeOptionalSetFn(var), usage, true};
-        flags.insert({name, flag});
+    inline void FlagSet::Var(std::optional<bool> &var, std::string_view name, std::string_view usage) {
+        add(name, detail::WithSnapshot(Flag{detail::MakeOptionalSetFn(var), usage, true}, var));
+    }
+
+    /// A member of a config struct Struct bound as a flag by Bind. Fields of any type that
+    /// FlagSet::Var accepts share the one type, so a struct's fields can be listed together,
+    /// once, and bound to any number of instances.
+    template<typename Struct>
+    class Field {
+    public:
+        template<typename T>
+        Field(T Struct::*member, std::string_view name, std::string_view usage)
+            : member(reinterpret_cast<char Struct::*>(member)), name(name), usage(usage), bind(&bindAs<T>) {}
+
+        /// Binds the field of config to flags.
+        inline void Bind(FlagSet &flags, Struct &config) const { bind(flags, config, *this); }
+
+        [[nodiscard]] inline std::string_view Name() const { return name; }
+        [[nodiscard]] inline std::string_view Usage() const { return usage; }
+
+    private:
+        using BindFn = void (*)(FlagSet &, Struct &, const Field &);
+
+        /// Restores the member's type, which converting back from char Struct::* preserves.
+        template<typename T>
+        static void bindAs(FlagSet &flags, Struct &config, const Field &field) {
+            flags.Var(config.*reinterpret_cast<T Struct::*>(field.member), field.name, field.usage);
+        }
+
+        char Struct::*member;
+        std::string_view name;
+        std::string_view usage;
+        BindFn bind;
+    };
+
+    /// Binds the listed fields of config as flags, for example
+    /// flag::Bind(flags, config, {{&Config::threads, "threads", "Worker threads"}, ...}).
+    /// Parsing writes into config, which must outlive flags.
+    template<typename Struct>
+    void Bind(FlagSet &flags, Struct &config, std::initializer_list<Field<Struct>> fields) {
+        for (const auto &field: fields) {
+            field.Bind(flags, config);
+        }
+    }
+
+    /// Binds fields, a range of Field<Struct> such as a static array, to config.
+    template<typename Struct, typename Fields>
+    void Bind(FlagSet &flags, Struct &config, const Fields &fields) {
+        for (const auto &field: fields) {
+            field.Bind(flags, config);
+        }
+    }
+
+    /// A flag defined with FLAG_DEFINE. Registrations are constant-initialized and linked into
+    /// a list when their translation unit is initialized, without allocating. The list is
+    /// indexed into a FlagSet by the first call to Registered.
+    class Registration {
+    public:
+        using SetFn = std::optional<FlagError> (*)(std::string_view);
+        using SnapshotFn = bool (*)(std::string *out, std::string_view *in);
+
+        constexpr Registration(const char *name, const char *usage, SetFn set, bool isBool,
+                               SnapshotFn snapshot = nullptr, std::uint32_t snapshotType = 0)
+            : name(name), usage(usage), set(set), isBool(isBool), snapshot(snapshot), snapshotType(snapshotType) {}
+        Registration(const Registration &) = delete;
+        Registration &operator=(const Registration &) = delete;
+
+    private:
+        friend FlagSet &Registered();
+        friend struct detail::RegistrationLink;
+
+        /// The first registration, constant-initialized so that it is null before any
+        /// translation unit links into it.
+        static inline Registration *head{nullptr};
+
+        const char *name;
+        const char *usage;
+        SetFn set;
+        bool isBool;
+        SnapshotFn snapshot;
+        std::uint32_t snapshotType;
+        Registration *next{nullptr};
+    };
+
+    namespace detail {
+        /// Links a Registration into the list, which is the only work done at static
+        /// initialization.
+        struct RegistrationLink {
+            explicit RegistrationLink(Registration &registration) {
+                registration.next = Registration::head;
+                Registration::head = &registration;
+            }
+        };
+
+        /// Converts into a variable with static storage, without any captured state.
+        template<typename T, T &Var>
+        std::optional<FlagError> SetStatic(std::string_view value) {
+            return MakeSetFn(Var)(value);
+        }
+
+        template<typename T, T &Var>
+        bool SnapshotStatic(std::string *out, std::string_view *in) {
+            if (out != nullptr) {
+                SnapshotTraits<T>::Save(*out, Var);
+                return true;
+            }
+            return SnapshotTraits<T>::Load(*in, Var);
+        }
+    }// namespace detail
+
+    /// @returns the FlagSet holding every flag defined with FLAG_DEFINE, built on the first
+    /// call. Flags must be defined in translation units that are initialized before then.
+    FLAGCXX_INLINE FlagSet &Registered();
+}// namespace flag
+
+/// Defines a flag variable FLAG_name of type, with a default value and usage, that is parsed by
+/// flag::Registered().Parse(argc, argv). Use at namespace scope, at most once per name.
+#define FLAG_DEFINE(type, name, defaultValue, usage)                                                     \
+    type FLAG_##name = defaultValue;                                                                     \
+    static FLAGCXX_CONSTINIT ::flag::Registration flagcxxRegistration_##name{                           \
+            #name, usage, &::flag::detail::SetStatic<type, FLAG_##name>, std::is_same_v<type, bool>,    \
+            &::flag::detail::SnapshotStatic<type, FLAG_##name>, ::flag::detail::SnapshotTraits<type>::tag}; \
+    static const ::flag::detail::RegistrationLink flagcxxLink_##name { flagcxxRegistration_##name }
+
+/// Declares a flag defined with FLAG_DEFINE in another translation unit.
+#define FLAG_DECLARE(type, name) extern type FLAG_##name
+
+namespace flag {
+
+    /// A flag value held by a ParseResult, std::monostate when the flag was not given.
+    using Value = std::variant<std::monostate, bool, std::int64_t, std::uint64_t, float, double, std::string_view>;
+
+    /// The values and positional arguments of one command line parsed against a FlagSchema.
+    /// String values and positional arguments are views into the parsed argv.
+    class ParseResult {
+    public:
+        /// @returns whether the named flag was given on the command line.
+        [[nodiscard]] FLAGCXX_INLINE bool Has(std::string_view name) const;
+
+        /// @returns the named flag's value, if it was given and is convertible to T.
+        /// Integer flags convert to any integral T that holds the value, other flags need T to
+        /// match their type.
+        template<typename T>
+        [[nodiscard]] inline std::optional<T> Get(std::string_view name) const;
+
+        /// @returns the value of the flag at the given schema index.
+        [[nodiscard]] inline const Value &At(std::size_t index) const { return values[index]; }
+
+        /// @returns the arguments remaining after flag parsing.
+        [[nodiscard]] inline Span<const std::string_view> Args() const { return positional; }
+
+    private:
+        friend class FlagSchema;
+
+        detail::SchemaView schema{};
+        std::vector<Value> values{};
+        std::vector<std::string_view> positional{};
+    };
+
+    /// The results of parsing many command lines against one FlagSchema, stored by column:
+    /// the values of one flag for every command line are contiguous.
+    class BatchResult {
+    public:
+        /// @returns the number of command lines parsed.
+        [[nodiscard]] inline std::size_t Size() const { return rows; }
+
+        /// @returns the values of the flag at the given schema index, one per command line.
+        [[nodiscard]] inline Span<const Value> Column(std::size_t index) const { return {values.data() + index * rows, rows}; }
+
+        /// @returns the values of the named flag, one per command line, or an empty span if
+        /// the flag is not declared.
+        [[nodiscard]] FLAGCXX_INLINE Span<const Value> Column(std::string_view name) const;
+
+        /// @returns the error that stopped parsing of a command line, if there was one.
+        [[nodiscard]] inline const std::optional<Error> &ErrorAt(std::size_t row) const { return errors[row]; }
+
+        /// @returns the arguments remaining after flag parsing of a command line, as the tail
+        /// of its argv.
+        [[nodiscard]] inline Span<const char *const> Args(std::size_t row) const { return positional[row]; }
+
+    private:
+        friend class FlagSchema;
+
+        detail::SchemaView schema{};
+        std::size_t rows{0};
+        std::vector<Value> values{};
+        std::vector<std::optional<Error>> errors{};
+        std::vector<Span<const char *const>> positional{};
+    };
+
+    /// An immutable set of flag declarations, built once and shared.
+    /// Parsing writes only to the caller's ParseResult, so any number of threads may parse
+    /// against one FlagSchema concurrently without locking.
+    class FlagSchema {
+    public:
+        /// Borrows the sorted table of a compile-time Schema, which must outlive this.
+        template<std::size_t N>
+        FlagSchema(const Schema<N> &schema) : view(schema.View()) {}
+
+        /// Sorts runtime declarations once. Later duplicates of a name are dropped.
+        /// The names and usage strings must outlive the FlagSchema.
+        FLAGCXX_INLINE explicit FlagSchema(std::vector<FlagSpec> specs);
+
+        FlagSchema(const FlagSchema &) = delete;
+        FlagSchema &operator=(const FlagSchema &) = delete;
+        FlagSchema(FlagSchema &&) = default;
+        FlagSchema &operator=(FlagSchema &&) = default;
+
+        [[nodiscard]] inline std::size_t Size() const { return view.size; }
+        [[nodiscard]] inline const FlagSpec &operator[](std::size_t i) const { return view.specs[i]; }
+        [[nodiscard]] inline std::optional<std::size_t> Find(std::string_view name) const { return view.Find(name); }
+
+        /// Parses a command line into result, reusing its storage.
+        /// @returns an optional error if one occurred.
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Error> Parse(int argc, const char **argv, ParseResult &result) const;
+
+        /// Parses many argv-like command lines, such as std::vector<const char *>, into
+        /// result, reusing its storage.
+        /// @returns the number of command lines that failed to parse.
+        template<typename Commands>
+        inline std::size_t ParseBatch(const Commands &commands, BatchResult &result) const;
+
+        /// Parses many command lines like ParseBatch(commands, result), distributing them
+        /// with executor(count, task). The executor must call task(i) once for every i in
+        /// [0, count), from any threads, and return after all calls have completed.
+        template<typename Commands, typename Executor>
+        inline std::size_t ParseBatch(const Commands &commands, BatchResult &result, Executor &&executor) const;
+
+    private:
+        friend class FlagSet;
+
+        /// @returns a Flag that converts the named flag's value into values[index * stride].
+        [[nodiscard]] FLAGCXX_INLINE std::optional<Flag> slot(std::string_view name, Value *values, std::size_t stride) const;
+
+        std::vector<FlagSpec> owned{};
+        detail::SchemaView view{};
+    };
+
+    template<typename T>
+    std::optional<T> ParseResult::Get(std::string_view name) const {
+        auto index = schema.Find(name);
+        if (!index) {
+            return {};
+        }
+        const auto &value = values[*index];
+        if constexpr (detail::IsFlagInteger<T>) {
+            auto fits = [](auto v) {
+                return !detail::Less(v, std::numeric_limits<T>::min()) && !detail::Less(std::numeric_limits<T>::max(), v);
+            };
+            if (auto i = std::get_if<std::int64_t>(&value); i && fits(*i)) {
+                return static_cast<T>(*i);
+            }
+            if (auto u = std::get_if<std::uint64_t>(&value); u && fits(*u)) {
+                return static_cast<T>(*u);
+            }
+            return {};
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            if (auto s = std::get_if<std::string_view>(&value)) {
+                return std::string(*s);
+            }
+            return {};
+        } else {
+            if (auto v = std::get_if<T>(&value)) {
+                return *v;
+            }
+            return {};
+        }
+    }
+
+    template<typename Commands>
+    std::size_t FlagSchema::ParseBatch(const Commands &commands, BatchResult &result) const {
+        return ParseBatch(commands, result, [](std::size_t count, const auto &task) {
+            for (std::size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+        });
+    }
+
+    template<typename Commands, typename Executor>
+    std::size_t FlagSchema::ParseBatch(const Commands &commands, BatchResult &result, Executor &&executor) const {
+        auto rows = static_cast<std::size_t>(std::size(commands));
+        result.schema = view;
+        result.rows = rows;
+        result.values.assign(view.size * rows, Value{});
+        result.errors.assign(rows, std::nullopt);
+        result.positional.assign(rows, Span<const char *const>{});
+
+        auto task = [&](std::size_t row) {
+            const auto &command = std::begin(commands)[static_cast<std::ptrdiff_t>(row)];
+            auto error = detail::ParseArgv(
+                    static_cast<int>(std::size(command)), std::data(command),
+                    [&](std::string_view name) { return slot(name, result.values.data() + row, rows); },
+                    [&](const char *const *rest, int count, bool) {
+                        result.positional[row] = Span<const char *const>{rest, static_cast<std::size_t>(count)};
+                    });
+            if (error) {
+                result.errors[row] = std::move(error);
+            }
+        };
+        executor(rows, task);
+
+        return static_cast<std::size_t>(std::count_if(result.errors.begin(), result.errors.end(),
+                                                      [](const std::optional<Error> &error) { return error.has_value(); }));
     }
+}// namespace flag
 
-}// namespace flag
\ No newline at end of file
+#if FLAGCXX_HEADER_ONLY
+#include "flag.cpp"
+#endif
@@ -1,10 +1,59 @@
 #include "flag.h"
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <new>
+#include <thread>
+
+// Counts every global allocation so tests can check the allocation budget of the parser.
+static std::atomic<std::size_t> allocations{0};
+
+// Every replaceable form is defined, so that each allocation is counted and each is released
+// by a matching operator delete. The release goes through an out-of-line helper so the compiler
+// does not pair an inlined std::free against the operator new of the caller.
+static FLAGCXX_NOINLINE void countedFree(void *p) noexcept { std::free(p); }
+
+static void *countedMalloc(std::size_t size) noexcept {
+    ++allocations;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new(std::size_t size) {
+    if (auto p = countedMalloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    if (auto p = countedMalloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return countedMalloc(size); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return countedMalloc(size); }
+
+void operator delete(void *p) noexcept { countedFree(p); }
+void operator delete[](void *p) noexcept { countedFree(p); }
+void operator delete(void *p, std::size_t) noexcept { countedFree(p); }
+void operator delete[](void *p, std::size_t) noexcept { countedFree(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { countedFree(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { countedFree(p); }
 
 void parse(flag::FlagSet& flags, std::vector<const char *> &v) {
   auto error = flags.Parse(static_cast<int>(v.size()), v.data());
-  CAPTURE(error->What());
+  CAPTURE(error ? error->What() : std::string{});
   REQUIRE(error.has_value() == false);
   REQUIRE(flags.Parsed() == true);
 }
@@ -18,6 +67,11 @@ flag::Error parseError(flag::FlagSet& flags, std::vector<const char *> &v) {
 
 using ArgsT = std::vector<const char *>;
 
+FLAG_DEFINE(int, registered_port, 8080, "A registered port");
+FLAG_DEFINE(bool, registered_verbose, false, "A registered boolean");
+FLAG_DEFINE(std::string, registered_name, "none", "A registered string");
+FLAG_DEFINE(double, registered_ratio, 0.5, "A registered ratio");
+
 TEST_CASE("Parse failures") {
     flag::FlagSet flags;
     std::optional<flag::Error> error;
@@ -353,4 +407,2084 @@ TEST_CASE("double") {
         REQUIRE(error.Type() == flag::Error::EType::BadValue);
         REQUIRE_THAT(d, WithinAbs(0, 0.01));
     }
+
+    SECTION("An explicit plus sign") {
+        ArgsT args{"program", "-d=+2.5"};
+        parse(flags, args);
+        REQUIRE_THAT(d, WithinAbs(2.5, 0.01));
+    }
+
+    SECTION("An exponent") {
+        ArgsT args{"program", "-d=1.5e3"};
+        parse(flags, args);
+        REQUIRE_THAT(d, WithinAbs(1500, 0.01));
+    }
+
+    SECTION("Out of range") {
+        ArgsT args{"program", "-d=1e400"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::BadValue);
+    }
+}
+
+TEST_CASE("Floating point fallback parser") {
+    auto parse = [](std::string_view s, auto &value) {
+        return flag::detail::ParseFloatFallback(s.data(), s.data() + s.size(), value);
+    };
+
+    double d{};
+    SECTION("Fast path values are exact") {
+        REQUIRE(parse("1.4", d).ec == std::errc{});
+        REQUIRE(d == 1.4);
+        REQUIRE(parse("-0.001", d).ec == std::errc{});
+        REQUIRE(d == -0.001);
+        REQUIRE(parse("12345e-2", d).ec == std::errc{});
+        REQUIRE(d == 123.45);
+        REQUIRE(parse("2E10", d).ec == std::errc{});
+        REQUIRE(d == 2e10);
+    }
+
+    SECTION("Long inputs take the slow path") {
+        REQUIRE(parse("3.14159265358979323846264338327950288", d).ec == std::errc{});
+        REQUIRE(d == 3.14159265358979323846264338327950288);
+        REQUIRE(parse("1e-300", d).ec == std::errc{});
+        REQUIRE(d == 1e-300);
+        auto longOne = "1." + std::string(150, '0');
+        REQUIRE(parse(longOne, d).ec == std::errc{});
+        REQUIRE(d == 1.0);
+        auto longPi = "3.14159265358979323846" + std::string(200, '0') + "1e0";
+        REQUIRE(parse(longPi, d).ec == std::errc{});
+        REQUIRE(d == 3.14159265358979323846);
+    }
+
+#if FLAGCXX_HAS_STRTOD_L
+    SECTION("Long inputs ignore LC_NUMERIC") {
+        std::string previous{std::setlocale(LC_NUMERIC, nullptr)};
+        for (auto name: {"de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8"}) {
+            if (std::setlocale(LC_NUMERIC, name) != nullptr) {
+                break;
+            }
+        }
+        CAPTURE(std::setlocale(LC_NUMERIC, nullptr));
+        REQUIRE(parse("3.14159265358979323846", d).ec == std::errc{});
+        REQUIRE(d == 3.14159265358979323846);
+        std::setlocale(LC_NUMERIC, previous.c_str());
+    }
+#endif
+
+    SECTION("Stops at the end of the number") {
+        std::string_view s{"2.5e"};
+        auto [ptr, ec] = parse(s, d);
+        REQUIRE(ec == std::errc{});
+        REQUIRE(ptr == s.data() + 3);
+        REQUIRE(d == 2.5);
+    }
+
+    SECTION("Errors") {
+        REQUIRE(parse("abc", d).ec == std::errc::invalid_argument);
+        REQUIRE(parse(".", d).ec == std::errc::invalid_argument);
+        REQUIRE(parse("1e400", d).ec == std::errc::result_out_of_range);
+    }
+
+    SECTION("float") {
+        float f{};
+        REQUIRE(parse("1.4", f).ec == std::errc{});
+        REQUIRE(f == 1.4f);
+        REQUIRE(parse("1e39", f).ec == std::errc::result_out_of_range);
+    }
+}
+
+TEST_CASE("Schema") {
+    static constexpr auto schema = flag::MakeSchema({
+            {"verbose", "Enable verbose output", flag::Type::Bool},
+            {"count", "The count of things", flag::Type::Int},
+            {"name", "The name of a thing", flag::Type::String},
+            {"amount", "The amount of something", flag::Type::Double},
+    });
+
+    static_assert(schema.Size() == 4);
+    static_assert(schema[0].name == "amount");
+    static_assert(schema[3].name == "verbose");
+    static_assert(*schema.Find("count") == 1);
+    static_assert(!schema.Find("missing"));
+
+    bool verbose{false};
+    int count{};
+    std::string name{};
+    flag::FlagSet flags{schema};
+    flags.Var(verbose, "verbose", "Enable verbose output");
+    flags.Var(count, "count", "The count of things");
+    flags.Var(name, "name", "The name of a thing");
+
+    SECTION("Declared flags are set") {
+        ArgsT args{"program", "-verbose", "-count=3", "-name=foo", "arg"};
+        parse(flags, args);
+        REQUIRE(verbose == true);
+        REQUIRE(count == 3);
+        REQUIRE(name == "foo");
+        REQUIRE(flags.Args().size() == 1);
+    }
+
+    SECTION("Declared but unbound flags are accepted") {
+        ArgsT args{"program", "-amount=1.5"};
+        parse(flags, args);
+        REQUIRE(flags.Args().empty());
+    }
+
+    SECTION("Flags outside the schema can still be bound") {
+        int extra{};
+        flags.Var(extra, "extra", "Not declared in the schema");
+        ArgsT args{"program", "-extra=7", "-count=2"};
+        parse(flags, args);
+        REQUIRE(extra == 7);
+        REQUIRE(count == 2);
+    }
+
+    SECTION("Undeclared flags are undefined") {
+        ArgsT args{"program", "-missing=1"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::UndefinedFlag);
+    }
+}
+
+TEST_CASE("Allocation budget") {
+    int i{};
+    bool b{false};
+    std::string s{};
+
+    SECTION("Var and Parse on a map-backed FlagSet") {
+        flag::FlagSet flags;
+        auto before = allocations.load();
+        flags.Var(i, "i", "An int flag");
+        flags.Var(b, "b", "A boolean flag");
+        flags.Var(s, "s", "A string flag");
+        // One node per flag plus the bucket array, or the flat tables.
+        REQUIRE(allocations - before <= 4);
+
+        ArgsT args{"program", "-i", "42", "-b", "--s=foo"};
+        before = allocations.load();
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(allocations - before == 0);
+        REQUIRE(!error);
+        REQUIRE(i == 42);
+        REQUIRE(b == true);
+        REQUIRE(s == "foo");
+    }
+
+    SECTION("Var and Parse on a schema-backed FlagSet") {
+        static constexpr auto schema = flag::MakeSchema({
+                {"i", "An int flag", flag::Type::Int},
+                {"b", "A boolean flag", flag::Type::Bool},
+                {"s", "A string flag", flag::Type::String},
+        });
+        flag::FlagSet flags{schema};
+        auto before = allocations.load();
+        flags.Var(i, "i", "An int flag");
+        flags.Var(b, "b", "A boolean flag");
+        flags.Var(s, "s", "A string flag");
+        REQUIRE(allocations - before == 0);
+
+        ArgsT args{"program", "-i=7", "-b=false", "-s", "bar"};
+        before = allocations.load();
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(allocations - before == 0);
+        REQUIRE(!error);
+        REQUIRE(i == 7);
+        REQUIRE(b == false);
+        REQUIRE(s == "bar");
+    }
+}
+
+TEST_CASE("Other arithmetic types") {
+    flag::FlagSet flags{};
+
+    SECTION("int64_t") {
+        std::int64_t i{};
+        flags.Var(i, "i", "An int64_t flag");
+        ArgsT args{"program", "-i=-9223372036854775808"};
+        parse(flags, args);
+        REQUIRE(i == std::numeric_limits<std::int64_t>::min());
+    }
+
+    SECTION("uint32_t out of range") {
+        std::uint32_t u{};
+        flags.Var(u, "u", "A uint32_t flag");
+        ArgsT args{"program", "-u=4294967296"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::BadValue);
+        REQUIRE(error.What().find("number is out of range") != std::string::npos);
+    }
+
+    SECTION("size_t rejects negative numbers") {
+        std::size_t n{};
+        flags.Var(n, "n", "A size_t flag");
+        ArgsT args{"program", "-n=-1"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::BadValue);
+    }
+
+    SECTION("Base prefixes") {
+        std::uint32_t x{}, o{}, b{};
+        int negative{};
+        flags.Var(x, "x", "A hex flag");
+        flags.Var(o, "o", "An octal flag");
+        flags.Var(b, "b", "A binary flag");
+        flags.Var(negative, "negative", "A negative hex flag");
+        ArgsT args{"program", "-x=0xfF", "-o=0o17", "-b=0b101", "-negative=-0x80000000"};
+        parse(flags, args);
+        REQUIRE(x == 255);
+        REQUIRE(o == 15);
+        REQUIRE(b == 5);
+        REQUIRE(negative == std::numeric_limits<int>::min());
+    }
+
+    SECTION("Prefixed values are range checked") {
+        std::int8_t i{};
+        flags.Var(i, "i", "An int8_t flag");
+        ArgsT args{"program", "-i=0x80"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.What().find("number is out of range") != std::string::npos);
+    }
+
+    SECTION("long double") {
+        long double d{};
+        flags.Var(d, "d", "A long double flag");
+        ArgsT args{"program", "-d=0.25"};
+        parse(flags, args);
+        REQUIRE(d == 0.25L);
+    }
+
+    SECTION("std::optional<uint64_t>") {
+        std::optional<std::uint64_t> u{};
+        flags.Var(u, "u", "An optional uint64_t flag");
+        ArgsT args{"program", "-u=0xffffffffffffffff"};
+        parse(flags, args);
+        REQUIRE(u.has_value());
+        REQUIRE(*u == std::numeric_limits<std::uint64_t>::max());
+    }
+}
+
+TEST_CASE("ArgsView") {
+    flag::FlagSet flags;
+    int i{};
+    flags.Var(i, "i", "An int flag");
+
+    ArgsT args{"program", "-i=1", "arg1", "arg2", "arg3"};
+    auto before = allocations.load();
+    auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+    auto view = flags.ArgsView();
+    REQUIRE(!error);
+    // A single allocation holds the views, the argument strings are not copied.
+    REQUIRE(allocations - before == 1);
+    REQUIRE(view.size() == 3);
+    REQUIRE(view[0] == "arg1");
+    REQUIRE(view[2] == "arg3");
+    REQUIRE(view[0].data() == args[2]);
+
+    SECTION("Args makes owning copies on demand") {
+        const auto &owned = flags.Args();
+        REQUIRE(owned.size() == 3);
+        REQUIRE(owned[1] == "arg2");
+        REQUIRE(owned[1].data() != args[3]);
+        REQUIRE(&flags.Args() == &owned);
+    }
+}
+
+TEST_CASE("FlagSchema") {
+    flag::FlagSchema schema{{
+            {"threads", "Number of worker threads", flag::Type::Int},
+            {"ratio", "A ratio", flag::Type::Double},
+            {"name", "A name", flag::Type::String},
+            {"verbose", "Verbose output", flag::Type::Bool},
+    }};
+    flag::ParseResult result;
+
+    SECTION("Values and positionals land in the result") {
+        ArgsT args{"program", "-threads", "8", "-ratio=0.5", "-verbose", "-name=job", "input"};
+        auto error = schema.Parse(static_cast<int>(args.size()), args.data(), result);
+        REQUIRE(!error);
+        REQUIRE(result.Get<int>("threads") == 8);
+        REQUIRE(result.Get<double>("ratio") == 0.5);
+        REQUIRE(result.Get<bool>("verbose") == true);
+        REQUIRE(result.Get<std::string_view>("name") == "job");
+        REQUIRE(result.Get<std::string>("name") == "job");
+        REQUIRE(result.Args().size() == 1);
+        REQUIRE(result.Args()[0] == "input");
+    }
+
+    SECTION("Flags not given have no value") {
+        ArgsT args{"program", "-threads=2"};
+        REQUIRE(!schema.Parse(static_cast<int>(args.size()), args.data(), result));
+        REQUIRE(result.Has("threads"));
+        REQUIRE(!result.Has("ratio"));
+        REQUIRE(!result.Get<double>("ratio"));
+        REQUIRE(!result.Get<double>("threads"));
+    }
+
+    SECTION("Integers that do not fit the requested type have no value") {
+        ArgsT big{"program", "-threads=300"};
+        REQUIRE(!schema.Parse(static_cast<int>(big.size()), big.data(), result));
+        REQUIRE(result.Get<std::uint16_t>("threads") == 300);
+        REQUIRE(!result.Get<std::uint8_t>("threads"));
+        REQUIRE(!result.Get<std::int8_t>("threads"));
+        ArgsT negative{"program", "-threads=-1"};
+        REQUIRE(!schema.Parse(static_cast<int>(negative.size()), negative.data(), result));
+        REQUIRE(result.Get<std::int8_t>("threads") == -1);
+        REQUIRE(!result.Get<std::uint64_t>("threads"));
+        REQUIRE(!result.Get<unsigned>("threads"));
+    }
+
+    SECTION("A result is reset by each parse") {
+        ArgsT first{"program", "-threads=2", "a"};
+        ArgsT second{"program", "-ratio=1.5"};
+        REQUIRE(!schema.Parse(static_cast<int>(first.size()), first.data(), result));
+        REQUIRE(!schema.Parse(static_cast<int>(second.size()), second.data(), result));
+        REQUIRE(!result.Has("threads"));
+        REQUIRE(result.Args().empty());
+    }
+
+    SECTION("Errors") {
+        ArgsT args{"program", "-threads=lots"};
+        auto error = schema.Parse(static_cast<int>(args.size()), args.data(), result);
+        REQUIRE(error);
+        REQUIRE(error->Type() == flag::Error::EType::BadValue);
+    }
+
+    SECTION("A FlagSet can bind variables to a FlagSchema") {
+        int threads{};
+        flag::FlagSet flags{schema};
+        flags.Var(threads, "threads", "Number of worker threads");
+        ArgsT args{"program", "-threads=3", "-ratio=2"};
+        parse(flags, args);
+        REQUIRE(threads == 3);
+    }
+
+    SECTION("Concurrent parsing against one schema") {
+        std::vector<std::thread> threads;
+        std::vector<int> failures(4, 0);
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t] {
+                flag::ParseResult local;
+                auto value = std::to_string(t);
+                for (int i = 0; i < 1000; ++i) {
+                    ArgsT args{"program", "-threads", value.c_str(), "-verbose=false"};
+                    auto error = schema.Parse(static_cast<int>(args.size()), args.data(), local);
+                    if (error || local.Get<int>("threads") != t || local.Get<bool>("verbose") != false) {
+                        failures[t]++;
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        REQUIRE(failures == std::vector<int>(4, 0));
+    }
+}
+
+TEST_CASE("ParseBatch") {
+    static constexpr auto declared = flag::MakeSchema({
+            {"threads", "Number of worker threads", flag::Type::Int},
+            {"verbose", "Verbose output", flag::Type::Bool},
+    });
+    flag::FlagSchema schema{declared};
+    flag::BatchResult result;
+
+    std::vector<ArgsT> commands{
+            {"program", "-threads=1", "a", "b"},
+            {"program", "-verbose"},
+            {"program", "-threads", "bad"},
+            {"program", "-threads=4", "--", "-c"},
+    };
+
+    auto check = [&] {
+        REQUIRE(result.Size() == 4);
+        auto threads = result.Column("threads");
+        REQUIRE(threads.size() == 4);
+        REQUIRE(std::get<std::int64_t>(threads[0]) == 1);
+        REQUIRE(std::holds_alternative<std::monostate>(threads[1]));
+        REQUIRE(std::get<std::int64_t>(threads[3]) == 4);
+        REQUIRE(std::get<bool>(result.Column("verbose")[1]) == true);
+        REQUIRE(result.Column("missing").empty());
+
+        REQUIRE(!result.ErrorAt(0));
+        REQUIRE(result.ErrorAt(2));
+        REQUIRE(result.ErrorAt(2)->Type() == flag::Error::EType::BadValue);
+
+        REQUIRE(result.Args(0).size() == 2);
+        REQUIRE(std::string_view(result.Args(0)[1]) == "b");
+        REQUIRE(result.Args(1).empty());
+        REQUIRE(std::string_view(result.Args(3)[0]) == "-c");
+    };
+
+    SECTION("Sequential") {
+        REQUIRE(schema.ParseBatch(commands, result) == 1);
+        check();
+    }
+
+    SECTION("With an executor") {
+        auto executor = [](std::size_t count, const auto &task) {
+            std::vector<std::thread> threads;
+            for (std::size_t t = 0; t < 2; ++t) {
+                threads.emplace_back([&, t] {
+                    for (auto i = t; i < count; i += 2) {
+                        task(i);
+                    }
+                });
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+        };
+        REQUIRE(schema.ParseBatch(commands, result, executor) == 1);
+        check();
+    }
+}
+
+TEST_CASE("Error details") {
+    flag::FlagSet flags;
+    int i{};
+    bool b{};
+    flags.Var(i, "i", "An int flag");
+    flags.Var(b, "b", "A boolean flag");
+
+    auto parseFailure = [&](ArgsT args) {
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(error.has_value());
+        return *error;
+    };
+
+    SECTION("Bad value") {
+        auto error = parseFailure({"program", "-b", "-i", "abc"});
+        REQUIRE(error.Type() == flag::Error::EType::BadValue);
+        REQUIRE(error.Index() == 2);
+        REQUIRE(error.Name() == "i");
+        REQUIRE(error.Value() == "abc");
+        REQUIRE(error.What() == "Bad value abc for flag i: number is not an integer");
+    }
+
+    SECTION("Bad boolean value") {
+        auto error = parseFailure({"program", "-b=maybe"});
+        REQUIRE(error.What() == "Bad boolean value maybe for flag b: Unknown boolean value");
+    }
+
+    SECTION("Undefined flag") {
+        auto error = parseFailure({"program", "-i=1", "--nope"});
+        REQUIRE(error.Index() == 2);
+        REQUIRE(error.Name() == "nope");
+        REQUIRE(error.What() == "Flag provided but not defined: nope");
+    }
+
+    SECTION("Missing value") {
+        auto error = parseFailure({"program", "-i"});
+        REQUIRE(error.What() == "Flag is missing a value: i");
+    }
+
+    SECTION("Bad syntax") {
+        auto error = parseFailure({"program", "---x"});
+        REQUIRE(error.What() == "Bad flag syntax: -x");
+    }
+
+    SECTION("Errors are formatted once, on demand") {
+        double d{};
+        flags.Var(d, "d", "A double flag");
+        ArgsT floatArgs{"program", "-d=zzz"};
+        auto before = allocations.load();
+        REQUIRE(flags.Parse(static_cast<int>(floatArgs.size()), floatArgs.data()));
+        REQUIRE(allocations - before == 0);
+
+        ArgsT args{"program", "-i=zzz"};
+        before = allocations.load();
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(allocations - before == 0);
+        REQUIRE(error.has_value());
+
+        const auto &message = error->What();
+        before = allocations.load();
+        REQUIRE(&error->What() == &message);
+        REQUIRE(allocations - before == 0);
+    }
+}
+
+// Writes a file in the temporary directory and returns its path.
+std::string writeTempFile(const std::string &name, const std::string &content) {
+    auto path = (std::filesystem::temp_directory_path() / name).string();
+    std::ofstream(path, std::ios::binary) << content;
+    return path;
+}
+
+TEST_CASE("Response files") {
+    int count{};
+    std::string name{};
+    bool verbose{false};
+    flag::FlagSet flags;
+    flags.Var(count, "count", "A count");
+    flags.Var(name, "name", "A name");
+    flags.Var(verbose, "verbose", "Verbose output");
+
+    SECTION("Arguments are read from the file") {
+        auto path = "@" + writeTempFile("flagcxx_response.rsp", "-count 3\n  --name=plain\t-verbose\n\"first arg\"");
+        ArgsT args{"program", path.c_str(), "second"};
+        parse(flags, args);
+        REQUIRE(count == 3);
+        REQUIRE(name == "plain");
+        REQUIRE(verbose == true);
+        REQUIRE(flags.ArgsView().size() == 2);
+        REQUIRE(flags.ArgsView()[0] == "first arg");
+        REQUIRE(flags.ArgsView()[1] == "second");
+    }
+
+    SECTION("Quoted tokens") {
+        auto path = "@" + writeTempFile("flagcxx_quoted.rsp", "-name \"two words\"");
+        ArgsT args{"program", path.c_str()};
+        parse(flags, args);
+        REQUIRE(name == "two words");
+    }
+
+    SECTION("Nested response files") {
+        auto inner = writeTempFile("flagcxx_inner.rsp", "-count=5");
+        auto outer = "@" + writeTempFile("flagcxx_outer.rsp", "-verbose @" + inner);
+        ArgsT args{"program", outer.c_str()};
+        parse(flags, args);
+        REQUIRE(count == 5);
+        REQUIRE(verbose == true);
+    }
+
+    SECTION("Missing files are errors") {
+        ArgsT args{"program", "@/nonexistent/flagcxx.rsp"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::BadFile);
+        REQUIRE(error.Name() == "/nonexistent/flagcxx.rsp");
+    }
+
+    SECTION("Errors report the index of the argument in argv") {
+        ArgsT missing{"program", "-count=1", "-verbose", "@/nonexistent/flagcxx.rsp"};
+        REQUIRE(parseError(flags, missing).Index() == 3);
+
+        auto inner = writeTempFile("flagcxx_bad_inner.rsp", "-zzz");
+        auto path = "@" + writeTempFile("flagcxx_bad.rsp", "-count 2 -verbose @" + inner);
+        ArgsT args{"program", path.c_str()};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::UndefinedFlag);
+        REQUIRE(error.Name() == "zzz");
+        REQUIRE(error.Index() == 1);
+
+        auto good = "@" + writeTempFile("flagcxx_good.rsp", "-count 2 -verbose");
+        ArgsT after{"program", good.c_str(), "-count=x"};
+        REQUIRE(parseError(flags, after).Index() == 2);
+    }
+
+    SECTION("Not expanded after --") {
+        ArgsT args{"program", "--", "@file"};
+        parse(flags, args);
+        REQUIRE(flags.ArgsView()[0] == "@file");
+    }
+
+    SECTION("Expansion can be disabled") {
+        flags.AllowResponseFiles(false);
+        ArgsT args{"program", "@file"};
+        parse(flags, args);
+        REQUIRE(flags.ArgsView()[0] == "@file");
+    }
+}
+
+TEST_CASE("Lazy") {
+    flag::Lazy<int> count{7};
+    flag::Lazy<bool> verbose{};
+    flag::Lazy<double> ratio{};
+    flag::FlagSet flags;
+    flags.Var(count, "count", "A lazily converted count");
+    flags.Var(verbose, "verbose", "A lazily converted boolean");
+    flags.Var(ratio, "ratio", "A lazily converted ratio");
+
+    SECTION("Values convert on first read") {
+        ArgsT args{"program", "-count", "12", "-verbose"};
+        parse(flags, args);
+        REQUIRE(count.IsSet());
+        REQUIRE(count.Raw() == "12");
+        REQUIRE(count.Get() == 12);
+        REQUIRE(*verbose == true);
+        REQUIRE(!ratio.IsSet());
+        REQUIRE(ratio.Get() == 0.0);
+    }
+
+    SECTION("Defaults are kept when not given") {
+        ArgsT args{"program"};
+        parse(flags, args);
+        REQUIRE(!count.IsSet());
+        REQUIRE(*count == 7);
+    }
+
+    SECTION("Parse does not convert") {
+        ArgsT args{"program", "-ratio=abc"};
+        parse(flags, args);
+        REQUIRE(ratio.Resolve().has_value());
+        REQUIRE(ratio.Get() == 0.0);
+    }
+
+    SECTION("Validate reports conversion errors up front") {
+        ArgsT args{"program", "-count=12", "-ratio=abc"};
+        parse(flags, args);
+        auto error = flags.Validate();
+        REQUIRE(error.has_value());
+        REQUIRE(error->Type() == flag::Error::EType::BadValue);
+        REQUIRE(error->What() == "Bad value abc for flag ratio: number is not a double");
+    }
+
+    SECTION("Validate succeeds when every value converts") {
+        ArgsT args{"program", "-count=12", "-ratio=0.5"};
+        parse(flags, args);
+        REQUIRE(!flags.Validate());
+        REQUIRE(ratio.Get() == 0.5);
+    }
+}
+
+TEST_CASE("Lists") {
+    flag::FlagSet flags;
+
+    SECTION("Repeated flags append") {
+        std::vector<std::string> shards{};
+        flags.Var(shards, "shard", "A shard address");
+        ArgsT args{"program", "--shard=a:1", "--shard", "b:2,c:3"};
+        parse(flags, args);
+        REQUIRE(shards == std::vector<std::string>{"a:1", "b:2", "c:3"});
+    }
+
+    SECTION("Elements are converted with the element setter") {
+        std::vector<int> ports{};
+        std::vector<double> weights{};
+        flags.Var(ports, "port", "A port");
+        flags.Var(weights, "weight", "A weight");
+        ArgsT args{"program", "-port=80,0x1bb", "-weight=0.5,1.5"};
+        parse(flags, args);
+        REQUIRE(ports == std::vector<int>{80, 443});
+        REQUIRE(weights == std::vector<double>{0.5, 1.5});
+    }
+
+    SECTION("A bad element rejects the whole occurrence") {
+        std::vector<int> ports{};
+        flags.Var(ports, "port", "A port");
+        ArgsT args{"program", "-port=1", "-port=2,x,3"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::BadValue);
+        REQUIRE(ports == std::vector<int>{1});
+    }
+
+    SECTION("string_view elements split in place") {
+        std::vector<std::string_view> inputs{};
+        flags.Var(inputs, "input", "An input");
+        ArgsT args{"program", "-input=x,,yz"};
+        auto before = allocations.load();
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(!error);
+        // Only the vector's storage is allocated, reserved once for all three elements.
+        REQUIRE(allocations - before == 1);
+        REQUIRE(inputs.size() == 3);
+        REQUIRE(inputs[0] == "x");
+        REQUIRE(inputs[1].empty());
+        REQUIRE(inputs[2] == "yz");
+        REQUIRE(inputs[2].data() == args[1] + 10);
+    }
+
+    SECTION("many occurrences grow geometrically") {
+        std::vector<std::string_view> shards{};
+        flags.Var(shards, "shard", "A shard");
+        ArgsT args{"program"};
+        for (int i = 0; i < 500; ++i) {
+            args.push_back(i % 100 == 0 ? "--shard=h:1,h:2" : "--shard=h:1");
+        }
+        auto before = allocations.load();
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(!error);
+        REQUIRE(shards.size() == 505);
+        REQUIRE(allocations - before <= 12);
+    }
+
+    SECTION("string_view flags") {
+        std::string_view name{};
+        flags.Var(name, "name", "A name");
+        ArgsT args{"program", "-name=value"};
+        parse(flags, args);
+        REQUIRE(name == "value");
+        REQUIRE(name.data() == args[1] + 6);
+    }
+}
+
+TEST_CASE("Tokenize") {
+    using Kind = flag::Token::Kind;
+
+    SECTION("classifies each argument") {
+        ArgsT args{"program", "-a", "--name=x=y", "value", "-", "---bad", "--"};
+        auto tokens = flag::Tokenize(static_cast<int>(args.size()), args.data());
+        REQUIRE(tokens.size() == 6);
+
+        REQUIRE(tokens[0].kind == Kind::Flag);
+        REQUIRE(tokens[0].index == 1);
+        REQUIRE(tokens[0].Name() == "a");
+        REQUIRE(!tokens[0].HasValue());
+
+        REQUIRE(tokens[1].kind == Kind::Flag);
+        REQUIRE(tokens[1].Name() == "name");
+        REQUIRE(tokens[1].HasValue());
+        REQUIRE(tokens[1].Value() == "x=y");
+
+        REQUIRE(tokens[2].kind == Kind::Positional);
+        REQUIRE(tokens[3].kind == Kind::Positional);
+        REQUIRE(tokens[4].kind == Kind::BadSyntax);
+        REQUIRE(tokens[5].kind == Kind::Terminator);
+        REQUIRE(tokens[5].index == 6);
+    }
+
+    SECTION("an empty value is still a value") {
+        auto token = flag::Classify("-name=", 1);
+        REQUIRE(token.kind == Kind::Flag);
+        REQUIRE(token.HasValue());
+        REQUIRE(token.Value().empty());
+    }
+
+    SECTION("parsing spans several chunks") {
+        flag::FlagSet flags{};
+        int last = 0;
+        flags.Var(last, "n", "A number");
+        std::vector<std::string> storage{};
+        for (int i = 0; i < 40; ++i) {
+            storage.push_back("-n=" + std::to_string(i));
+        }
+        ArgsT args{"program"};
+        for (auto &arg: storage) {
+            args.push_back(arg.c_str());
+        }
+        args.push_back("-n");
+        args.push_back("99");
+        args.push_back("tail");
+        parse(flags, args);
+        REQUIRE(last == 99);
+        REQUIRE(flags.Args() == std::vector<std::string>{"tail"});
+    }
+}
+
+TEST_CASE("Many flags") {
+    flag::FlagSet flags{};
+    std::vector<std::string> names{};
+    std::vector<int> values(100);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        names.push_back("flag" + std::to_string(i));
+    }
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        flags.Var(values[i], names[i], "A numbered flag");
+    }
+
+    SECTION("every flag is found") {
+        std::vector<std::string> storage{};
+        ArgsT args{"program"};
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            storage.push_back("--" + names[i] + "=" + std::to_string(i * 2));
+        }
+        for (auto &arg: storage) {
+            args.push_back(arg.c_str());
+        }
+        parse(flags, args);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            REQUIRE(values[i] == static_cast<int>(i * 2));
+        }
+    }
+
+    SECTION("the first flag bound to a name wins") {
+        int other = 0;
+        flags.Var(other, "flag7", "A duplicate");
+        ArgsT args{"program", "--flag7=3"};
+        parse(flags, args);
+        REQUIRE(values[7] == 3);
+        REQUIRE(other == 0);
+    }
+
+    SECTION("names are not matched by prefix") {
+        ArgsT args{"program", "--flag1000=1"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::UndefinedFlag);
+    }
+}
+
+TEST_CASE("Environment") {
+    flag::FlagSet flags{};
+    int port = 0;
+    bool verbose = false;
+    std::string logLevel{};
+    std::string untouched{"kept"};
+    flags.Var(port, "port", "The port");
+    flags.Var(verbose, "verbose", "Verbose output");
+    flags.Var(logLevel, "log-level", "The log level");
+    flags.Var(untouched, "untouched", "Not in the environment");
+
+    SECTION("maps prefixed variables onto flags") {
+        const char *env[] = {"PATH=/usr/bin", "APP_PORT=8080", "APP_VERBOSE=", "APP_LOG_LEVEL=debug",
+                             "APP_UNKNOWN=1", "APPPORT=1", "OTHER_PORT=1", nullptr};
+        auto error = flags.ParseEnv("APP", env);
+        REQUIRE(!error);
+        REQUIRE(port == 8080);
+        REQUIRE(verbose);
+        REQUIRE(logLevel == "debug");
+        REQUIRE(untouched == "kept");
+        REQUIRE(flags.SourceOf("port") == flag::Source::Environment);
+        REQUIRE(flags.SourceOf("log-level") == flag::Source::Environment);
+        REQUIRE(flags.SourceOf("untouched") == flag::Source::Default);
+        REQUIRE(!flags.SourceOf("unknown"));
+    }
+
+    SECTION("the command line takes precedence") {
+        const char *env[] = {"APP_PORT=8080", "APP_LOG_LEVEL=debug", nullptr};
+        ArgsT args{"program", "--port=9090"};
+        parse(flags, args);
+        REQUIRE(flags.SourceOf("port") == flag::Source::CommandLine);
+
+        auto error = flags.ParseEnv("APP", env);
+        REQUIRE(!error);
+        REQUIRE(port == 9090);
+        REQUIRE(logLevel == "debug");
+        REQUIRE(flags.SourceOf("port") == flag::Source::CommandLine);
+        REQUIRE(flags.SourceOf("log-level") == flag::Source::Environment);
+    }
+
+    SECTION("parsing after the environment overrides it") {
+        const char *env[] = {"APP_PORT=8080", nullptr};
+        REQUIRE(!flags.ParseEnv("APP", env));
+        ArgsT args{"program", "--port", "9090"};
+        parse(flags, args);
+        REQUIRE(port == 9090);
+        REQUIRE(flags.SourceOf("port") == flag::Source::CommandLine);
+    }
+
+    SECTION("bad values name the variable") {
+        const char *env[] = {"APP_PORT=http", nullptr};
+        auto error = flags.ParseEnv("APP", env);
+        REQUIRE(error);
+        REQUIRE(error->Type() == flag::Error::EType::BadValue);
+        REQUIRE(error->Name() == "APP_PORT");
+        REQUIRE(error->Value() == "http");
+        REQUIRE(error->Index() == -1);
+    }
+
+    SECTION("the process environment") {
+        ::setenv("FLAGCXX_TEST_PORT", "1234", 1);
+        auto error = flags.ParseEnv("FLAGCXX_TEST");
+        ::unsetenv("FLAGCXX_TEST_PORT");
+        REQUIRE(!error);
+        REQUIRE(port == 1234);
+    }
+}
+
+TEST_CASE("Config files") {
+    flag::FlagSet flags{};
+    int port = 0;
+    bool verbose = false;
+    std::string name{};
+    std::string level{};
+    flags.Var(port, "port", "The port");
+    flags.Var(verbose, "verbose", "Verbose output");
+    flags.Var(name, "name", "A name");
+    flags.Var(level, "log.level", "The log level");
+
+    SECTION("key=value lines and sections") {
+        auto path = writeTempFile("flagcxx_config.ini",
+                                  "# A comment\r\n"
+                                  "port = 8080\r\n"
+                                  "; another comment\n"
+                                  "\n"
+                                  "name = \"quoted value\"\n"
+                                  "verbose\n"
+                                  "[log]\n"
+                                  "  level=debug  ");
+        auto error = flags.ParseFile(path);
+        CAPTURE(error ? error->What() : std::string{});
+        REQUIRE(!error);
+        REQUIRE(port == 8080);
+        REQUIRE(verbose);
+        REQUIRE(name == "quoted value");
+        REQUIRE(level == "debug");
+        REQUIRE(flags.SourceOf("port") == flag::Source::File);
+    }
+
+    SECTION("sources layer as file < env < command line") {
+        auto path = writeTempFile("flagcxx_layers.ini", "port=1\nname=file\nlog.level=file\n");
+        const char *env[] = {"APP_PORT=2", "APP_NAME=env", nullptr};
+        ArgsT args{"program", "--port=3"};
+
+        parse(flags, args);
+        REQUIRE(!flags.ParseFile(path));
+        REQUIRE(!flags.ParseEnv("APP", env));
+        REQUIRE(port == 3);
+        REQUIRE(name == "env");
+        REQUIRE(level == "file");
+        REQUIRE(flags.SourceOf("port") == flag::Source::CommandLine);
+        REQUIRE(flags.SourceOf("name") == flag::Source::Environment);
+        REQUIRE(flags.SourceOf("log.level") == flag::Source::File);
+    }
+
+    SECTION("list flags layer the same in any order") {
+        auto path = writeTempFile("flagcxx_lists.ini", "host=file1\nhost=file2\nport=1\n");
+        const char *env[] = {"APP_HOST=env1,env2", "APP_PORT=2", nullptr};
+        std::array<int, 3> order{0, 1, 2};
+        do {
+            flag::FlagSet layered{};
+            std::vector<std::string> hosts{"default"};
+            std::vector<int> ports{};
+            layered.Var(hosts, "host", "Hosts");
+            layered.Var(ports, "port", "Ports");
+            for (auto source: order) {
+                if (source == 0) {
+                    REQUIRE(!layered.ParseFile(path));
+                } else if (source == 1) {
+                    REQUIRE(!layered.ParseEnv("APP", env));
+                } else {
+                    ArgsT args{"program", "--host=cli1", "--host=cli2"};
+                    parse(layered, args);
+                }
+            }
+            CAPTURE(order);
+            REQUIRE(hosts == std::vector<std::string>{"default", "cli1", "cli2"});
+            REQUIRE(ports == std::vector<int>{2});
+            REQUIRE(layered.SourceOf("host") == flag::Source::CommandLine);
+        } while (std::next_permutation(order.begin(), order.end()));
+    }
+
+    SECTION("errors report the line and column") {
+        auto path = writeTempFile("flagcxx_bad.ini", "port = 1\n\n  port =  http\n");
+        auto error = flags.ParseFile(path);
+        REQUIRE(error);
+        REQUIRE(error->Type() == flag::Error::EType::BadValue);
+        REQUIRE(error->File() == path);
+        REQUIRE(error->Line() == 3);
+        REQUIRE(error->Column() == 11);
+        REQUIRE(error->Value() == "http");
+        REQUIRE(error->What().find(path + ":3:11: Bad value http for flag port") == 0);
+    }
+
+    SECTION("undefined names and missing values") {
+        auto undefined = flags.ParseFile(writeTempFile("flagcxx_undefined.ini", "[server]\n host = x\n"));
+        REQUIRE(undefined);
+        REQUIRE(undefined->Type() == flag::Error::EType::UndefinedFlag);
+        REQUIRE(undefined->Line() == 2);
+        REQUIRE(undefined->Column() == 2);
+
+        auto missing = flags.ParseFile(writeTempFile("flagcxx_missing.ini", "name\n"));
+        REQUIRE(missing);
+        REQUIRE(missing->Type() == flag::Error::EType::MissingValue);
+
+        auto section = flags.ParseFile(writeTempFile("flagcxx_section.ini", "[log\n"));
+        REQUIRE(section);
+        REQUIRE(section->Type() == flag::Error::EType::BadSyntax);
+    }
+
+    SECTION("unreadable files") {
+        auto error = flags.ParseFile("/nonexistent/flagcxx.ini");
+        REQUIRE(error);
+        REQUIRE(error->Type() == flag::Error::EType::BadFile);
+        REQUIRE(error->What().find("Cannot read file /nonexistent/flagcxx.ini") == 0);
+    }
+}
+
+TEST_CASE("Live") {
+    flag::FlagSet flags{};
+    flag::Live<int> batch{8};
+    flag::Live<std::string> mode{"fast"};
+    int fixed = 0;
+    flags.Var(batch, "batch", "The batch size");
+    flags.Var(mode, "mode", "The mode");
+    flags.Var(fixed, "fixed", "Not reloadable");
+
+    SECTION("Parse sets the current snapshot") {
+        ArgsT args{"program", "--batch=16"};
+        parse(flags, args);
+        REQUIRE(*batch == 16);
+        REQUIRE(*mode == "fast");
+    }
+
+    SECTION("Reload publishes new snapshots") {
+        auto path = writeTempFile("flagcxx_live.ini", "batch = 32\nfixed = 5\n");
+        auto error = flags.Reload([&](flag::FlagSet &f) { return f.ParseFile(path); });
+        REQUIRE(!error);
+        REQUIRE(*batch == 32);
+        REQUIRE(*mode == "fast");
+        // Only flags bound to a Live change.
+        REQUIRE(fixed == 0);
+        REQUIRE(flags.SourceOf("fixed") == flag::Source::Default);
+        REQUIRE(flags.SourceOf("batch") == flag::Source::File);
+    }
+
+    SECTION("repeated Reloads release their files") {
+        auto path = writeTempFile("flagcxx_reload.ini", "batch = 32\nmode = slow\n");
+        auto mappings = [] {
+            std::ifstream maps("/proc/self/maps");
+            return std::count(std::istreambuf_iterator<char>(maps), std::istreambuf_iterator<char>(), '\n');
+        };
+        ArgsT args{"program", "first", "second"};
+        parse(flags, args);
+        auto before = mappings();
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(!flags.Reload([&](flag::FlagSet &f) { return f.ParseFile(path); }));
+            ArgsT reload{"program", "--batch=16", "third"};
+            REQUIRE(!flags.Reload([&](flag::FlagSet &f) { return f.Parse(static_cast<int>(reload.size()), reload.data()); }));
+        }
+        REQUIRE(mappings() < before + 16);
+        REQUIRE(*batch == 16);
+        REQUIRE(*mode == "slow");
+        REQUIRE(flags.Args() == std::vector<std::string>{"first", "second"});
+        parse(flags, args);
+        REQUIRE(flags.ArgsView().size() == 2);
+    }
+
+    SECTION("a failed file Reload returns a usable error") {
+        auto path = writeTempFile("flagcxx_reload_bad.ini", "batch = 32\nnope = 1\n");
+        auto error = flags.Reload([&](flag::FlagSet &f) { return f.ParseFile(path); });
+        REQUIRE(error);
+        auto copy = *error;
+        REQUIRE(error->Type() == flag::Error::EType::UndefinedFlag);
+        REQUIRE(error->Name() == "nope");
+        REQUIRE(copy.Name() == "nope");
+        REQUIRE(copy.What().find("Flag provided but not defined: nope") != std::string::npos);
+        REQUIRE(*batch == 8);
+    }
+
+    SECTION("a snapshot Reload leaves other flags alone") {
+        std::string_view label{};
+        flags.Var(label, "label", "A label");
+        ArgsT args{"program", "--fixed=10", "--batch=16", "--label=saved"};
+        parse(flags, args);
+        auto path = writeTempFile("flagcxx_reload.snapshot", flags.SaveSnapshot());
+        fixed = 11;
+        ArgsT reload{"program", "--batch=4"};
+        REQUIRE(!flags.Reload([&](flag::FlagSet &f) { return f.Parse(static_cast<int>(reload.size()), reload.data()); }));
+        REQUIRE(*batch == 4);
+        auto error = flags.Reload([&](flag::FlagSet &f) { return f.LoadSnapshotFile(path); });
+        CAPTURE(error ? error->What() : std::string{});
+        REQUIRE(!error);
+        REQUIRE(*batch == 16);
+        REQUIRE(fixed == 11);
+        REQUIRE(label.data() == args[3] + 8);
+    }
+
+    SECTION("a failed Reload publishes nothing") {
+        ArgsT args{"program", "--mode=slow", "--batch=x"};
+        auto error = flags.Reload([&](flag::FlagSet &f) { return f.Parse(static_cast<int>(args.size()), args.data()); });
+        REQUIRE(error);
+        REQUIRE(*mode == "fast");
+        REQUIRE(*batch == 8);
+    }
+
+    SECTION("retired snapshots outlive references until a quiescent state") {
+        flag::LiveReader reader{};
+        const auto &before = *mode;
+        ArgsT args{"program", "--mode=slow"};
+        REQUIRE(!flags.Reload([&](flag::FlagSet &f) { return f.Parse(static_cast<int>(args.size()), args.data()); }));
+        REQUIRE(*mode == "slow");
+        REQUIRE(before == "fast");
+        reader.Quiescent();
+    }
+
+    SECTION("readers on other threads") {
+        std::atomic<bool> done{false};
+        std::atomic<int> torn{0};
+        std::vector<std::thread> readers{};
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&] {
+                flag::LiveReader reader{};
+                while (!done.load()) {
+                    auto value = *batch;
+                    if ((value != 8 && value % 2 == 0) || (*mode != "fast" && *mode != "steady")) {
+                        ++torn;
+                    }
+                    reader.Quiescent();
+                }
+            });
+        }
+        std::vector<std::string> values{};
+        for (int i = 0; i < 200; ++i) {
+            values.push_back("--batch=" + std::to_string(2 * i + 1));
+        }
+        for (auto &value: values) {
+            ArgsT args{"program", value.c_str(), "--mode=steady"};
+            REQUIRE(!flags.Reload([&](flag::FlagSet &f) { return f.Parse(static_cast<int>(args.size()), args.data()); }));
+        }
+        done = true;
+        for (auto &thread: readers) {
+            thread.join();
+        }
+        REQUIRE(torn == 0);
+        REQUIRE(*batch == 399);
+    }
+}
+
+TEST_CASE("Atomic flags") {
+    flag::FlagSet flags{};
+    std::atomic<int> threads{1};
+    std::atomic<bool> verbose{false};
+    std::atomic<double> ratio{0.5};
+    flags.Var(threads, "threads", "Worker threads");
+    flags.Var(verbose, "verbose", "Verbose output");
+    flags.Var(ratio, "ratio", "A ratio");
+
+    SECTION("Parse stores converted values") {
+        ArgsT args{"program", "--threads=8", "-verbose", "--ratio", "0.25"};
+        parse(flags, args);
+        REQUIRE(threads == 8);
+        REQUIRE(verbose);
+        REQUIRE(ratio == 0.25);
+    }
+
+    SECTION("invalid values are not stored") {
+        ArgsT args{"program", "--threads=many"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::BadValue);
+        REQUIRE(threads == 1);
+    }
+
+    SECTION("Reload stores while other threads read") {
+        std::atomic<bool> done{false};
+        std::atomic<int> bad{0};
+        std::thread reader([&] {
+            while (!done.load()) {
+                auto value = threads.load(std::memory_order_acquire);
+                if (value < 1 || value > 100) {
+                    ++bad;
+                }
+            }
+        });
+        std::vector<std::string> values{};
+        for (int i = 1; i <= 100; ++i) {
+            values.push_back("--threads=" + std::to_string(i));
+        }
+        for (auto &value: values) {
+            ArgsT args{"program", value.c_str()};
+            REQUIRE(!flags.Reload([&](flag::FlagSet &f) { return f.Parse(static_cast<int>(args.size()), args.data()); }));
+        }
+        done = true;
+        reader.join();
+        REQUIRE(bad == 0);
+        REQUIRE(threads == 100);
+    }
+}
+
+TEST_CASE("Incremental parsing") {
+    flag::FlagSet flags{};
+    int count = 0;
+    std::string name{};
+    std::string_view view{};
+    bool verbose = false;
+    flags.Var(count, "count", "A count");
+    flags.Var(name, "name", "A name");
+    flags.Var(view, "view", "A view");
+    flags.Var(verbose, "verbose", "Verbose output");
+
+    SECTION("whole tokens") {
+        flag::IncrementalParser parser{flags};
+        REQUIRE(!parser.Feed("--count"));
+        REQUIRE(!parser.Feed("3"));
+        REQUIRE(!parser.Feed("-verbose"));
+        REQUIRE(!parser.Feed("rest"));
+        REQUIRE(!parser.Feed("--name=ignored"));
+        REQUIRE(!parser.Finish());
+        REQUIRE(count == 3);
+        REQUIRE(verbose);
+        REQUIRE(name.empty());
+        REQUIRE(parser.Args().size() == 2);
+        REQUIRE(parser.Args()[0] == "rest");
+        REQUIRE(parser.Args()[1] == "--name=ignored");
+        REQUIRE(flags.Parsed());
+    }
+
+    SECTION("bytes split anywhere") {
+        std::string input("--name\0long value\0--cou", 23);
+        std::string more("nt\0", 3);
+        std::string last("42\0--\0-x", 8);
+        flag::IncrementalParser parser{flags};
+        // Split the first chunk inside the value that follows its flag.
+        REQUIRE(!parser.FeedBytes(std::string_view(input).substr(0, 10)));
+        REQUIRE(name.empty());
+        REQUIRE(!parser.FeedBytes(std::string_view(input).substr(10)));
+        REQUIRE(name == "long value");
+        REQUIRE(!parser.FeedBytes(more));
+        REQUIRE(!parser.FeedBytes(last));
+        REQUIRE(!parser.Finish());
+        REQUIRE(count == 42);
+        REQUIRE(parser.Args().size() == 1);
+        REQUIRE(parser.Args()[0] == "-x");
+    }
+
+    SECTION("views stay valid as blocks fill") {
+        flag::IncrementalParser parser{flags, '\n'};
+        REQUIRE(!parser.FeedBytes("-view\n"));
+        REQUIRE(!parser.FeedBytes(std::string(3000, 'a')));
+        REQUIRE(!parser.FeedBytes(std::string(3000, 'a') + "\npos"));
+        REQUIRE(!parser.FeedBytes(std::string(5000, 'b')));
+        REQUIRE(!parser.Finish());
+        REQUIRE(view == std::string(6000, 'a'));
+        REQUIRE(parser.Args().size() == 1);
+        REQUIRE(parser.Args()[0] == "pos" + std::string(5000, 'b'));
+    }
+
+    SECTION("errors") {
+        flag::IncrementalParser parser{flags};
+        REQUIRE(!parser.Feed("--count"));
+        auto missing = parser.Finish();
+        REQUIRE(missing);
+        REQUIRE(missing->Type() == flag::Error::EType::MissingValue);
+
+        flag::IncrementalParser other{flags};
+        REQUIRE(!other.Feed("-verbose"));
+        auto undefined = other.Feed("--nope");
+        REQUIRE(undefined);
+        REQUIRE(undefined->Type() == flag::Error::EType::UndefinedFlag);
+        REQUIRE(undefined->Index() == 1);
+        REQUIRE(other.Feed("--count=1"));
+        REQUIRE(count == 0);
+    }
+}
+
+TEST_CASE("Range parsing") {
+    flag::FlagSet flags{};
+    int count = 0;
+    std::string_view name{};
+    flags.Var(count, "count", "A count");
+    flags.Var(name, "name", "A name");
+
+    SECTION("std::vector<std::string>") {
+        std::vector<std::string> args{"--count", "7", "--name=x", "rest"};
+        auto error = flags.Parse(args);
+        REQUIRE(!error);
+        REQUIRE(count == 7);
+        REQUIRE(name == "x");
+        REQUIRE(flags.ArgsView().size() == 1);
+        REQUIRE(flags.ArgsView()[0].data() == args[3].data());
+    }
+
+    SECTION("slices of a buffer that are not NUL-terminated") {
+        std::string_view buffer = "--count=12--name=abcrest";
+        std::vector<std::string_view> args{buffer.substr(0, 10), buffer.substr(10, 10), buffer.substr(20)};
+        auto before = allocations.load();
+        auto error = flags.Parse(args);
+        REQUIRE(!error);
+        REQUIRE(count == 12);
+        REQUIRE(name == "abc");
+        REQUIRE(flags.ArgsView()[0] == "rest");
+        // Only the positional views are stored.
+        REQUIRE(allocations - before <= 1);
+    }
+
+    SECTION("forward-only ranges") {
+        std::list<std::string> args{"--count", "3", "--", "-x", "y"};
+        REQUIRE(!flags.Parse(args));
+        REQUIRE(count == 3);
+        REQUIRE(flags.Args() == std::vector<std::string>{"-x", "y"});
+    }
+
+    SECTION("error indexes count from 0") {
+        std::vector<std::string> args{"--count=1", "--nope"};
+        auto error = flags.Parse(args);
+        REQUIRE(error);
+        REQUIRE(error->Type() == flag::Error::EType::UndefinedFlag);
+        REQUIRE(error->Index() == 1);
+    }
+
+    SECTION("response files") {
+        auto path = "@" + writeTempFile("flagcxx_range.rsp", "--count 5");
+        std::vector<std::string> args{path, "--name=n"};
+        REQUIRE(!flags.Parse(args));
+        REQUIRE(count == 5);
+        REQUIRE(name == "n");
+    }
+}
+
+TEST_CASE("Registered flags") {
+    REQUIRE(FLAG_registered_port == 8080);
+    REQUIRE(FLAG_registered_name == "none");
+
+    ArgsT args{"program", "--registered_port=9", "-registered_verbose", "--registered_name", "set", "rest"};
+    auto &flags = flag::Registered();
+    REQUIRE(&flags == &flag::Registered());
+    auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+    REQUIRE(!error);
+    REQUIRE(FLAG_registered_port == 9);
+    REQUIRE(FLAG_registered_verbose);
+    REQUIRE(FLAG_registered_name == "set");
+    REQUIRE(FLAG_registered_ratio == 0.5);
+    REQUIRE(flags.SourceOf("registered_port") == flag::Source::CommandLine);
+    REQUIRE(flags.Args() == std::vector<std::string>{"rest"});
+
+    ArgsT bad{"program", "--registered_ratio=half"};
+    auto badError = flags.Parse(static_cast<int>(bad.size()), bad.data());
+    REQUIRE(badError);
+    REQUIRE(badError->Type() == flag::Error::EType::BadValue);
+}
+
+TEST_CASE("Subcommands") {
+    flag::FlagSet flags{};
+    bool verbose = false;
+    int port = 0;
+    std::string table{};
+    int built = 0;
+    flags.Var(verbose, "verbose", "Verbose output");
+    flags.Subcommand("serve", "Run the server", [&port, &built](flag::FlagSet &child) {
+        ++built;
+        child.Var(port, "port", "The port");
+    });
+    flags.Subcommand("dump", "Dump a table", [&table, &built](flag::FlagSet &child) {
+        ++built;
+        child.Var(table, "table", "The table");
+    });
+
+    SECTION("the first argument after the flags selects a child") {
+        ArgsT args{"program", "-verbose", "serve", "--port=80", "extra"};
+        parse(flags, args);
+        REQUIRE(verbose);
+        REQUIRE(flags.Chosen() == "serve");
+        REQUIRE(flags.Child() != nullptr);
+        REQUIRE(port == 80);
+        // Only the chosen subcommand's factory ran.
+        REQUIRE(built == 1);
+        REQUIRE(flags.ArgsView().size() == 0);
+        REQUIRE(flags.Child()->Args() == std::vector<std::string>{"extra"});
+    }
+
+    SECTION("child flags are not parent flags") {
+        ArgsT args{"program", "dump", "--verbose"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::UndefinedFlag);
+        REQUIRE(error.Index() == 2);
+
+        ArgsT parent{"program", "--port=1", "serve"};
+        auto parentError = parseError(flags, parent);
+        REQUIRE(parentError.Type() == flag::Error::EType::UndefinedFlag);
+    }
+
+    SECTION("unknown subcommands") {
+        ArgsT args{"program", "-verbose", "deploy"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.Type() == flag::Error::EType::UndefinedCommand);
+        REQUIRE(error.Name() == "deploy");
+        REQUIRE(error.Index() == 2);
+        REQUIRE(error.What() == "Command provided but not defined: deploy");
+        REQUIRE(built == 0);
+    }
+
+    SECTION("no subcommand") {
+        ArgsT first{"program", "serve"};
+        parse(flags, first);
+        ArgsT args{"program", "-verbose"};
+        parse(flags, args);
+        REQUIRE(flags.Chosen().empty());
+        REQUIRE(flags.Child() == nullptr);
+
+        ArgsT terminated{"program", "--", "serve"};
+        parse(flags, terminated);
+        REQUIRE(flags.Child() == nullptr);
+        REQUIRE(flags.ArgsView().back() == "serve");
+    }
+
+    SECTION("ranges") {
+        std::vector<std::string> args{"serve", "--port", "443"};
+        REQUIRE(!flags.Parse(args));
+        REQUIRE(port == 443);
+    }
+}
+
+TEST_CASE("Observers") {
+    flag::FlagSet flags{};
+    int count = 0;
+    bool verbose = false;
+    flags.Var(count, "count", "A count");
+    flags.Var(verbose, "verbose", "Verbose output");
+
+    struct Recorder {
+        std::vector<std::string> flags{};
+        std::vector<flag::Error::EType> errors{};
+        void OnFlag(const flag::FlagEvent &event) {
+            flags.push_back(std::string(event.name) + "=" + std::string(event.value));
+            REQUIRE(event.duration.count() >= 0);
+        }
+        void OnError(const flag::Error &error) { errors.push_back(error.Type()); }
+    };
+
+    SECTION("OnFlag and OnError") {
+        Recorder recorder{};
+        ArgsT args{"program", "--count=3", "-verbose", "--count", "4"};
+        REQUIRE(!flags.Parse(static_cast<int>(args.size()), args.data(), recorder));
+        REQUIRE(recorder.flags == std::vector<std::string>{"count=3", "verbose=true", "count=4"});
+        REQUIRE(recorder.errors.empty());
+
+        ArgsT bad{"program", "--count=x"};
+        REQUIRE(flags.Parse(static_cast<int>(bad.size()), bad.data(), recorder));
+        REQUIRE(recorder.errors == std::vector<flag::Error::EType>{flag::Error::EType::BadValue});
+        REQUIRE(recorder.flags.size() == 3);
+
+        std::vector<std::string> range{"--nope"};
+        REQUIRE(flags.Parse(range, recorder));
+        REQUIRE(recorder.errors.back() == flag::Error::EType::UndefinedFlag);
+    }
+
+    SECTION("Counters") {
+        flag::Counters counters{flags};
+        ArgsT args{"program", "--count=3", "--count=4"};
+        ArgsT bad{"program", "--nope"};
+        REQUIRE(!flags.Parse(static_cast<int>(args.size()), args.data(), counters));
+        REQUIRE(flags.Parse(static_cast<int>(bad.size()), bad.data(), counters));
+        REQUIRE(counters.Hits("count") == 2);
+        REQUIRE(counters.Hits("verbose") == 0);
+        REQUIRE(counters.Hits("missing") == 0);
+        REQUIRE(counters.Errors(flag::Error::EType::UndefinedFlag) == 1);
+        REQUIRE(counters.Table() == "count\t2\nverbose\t0\n");
+    }
+
+    SECTION("subcommand flags are observed") {
+        int port = 0;
+        flags.Subcommand("serve", "Serve", [&port](flag::FlagSet &child) { child.Var(port, "port", "The port"); });
+        Recorder recorder{};
+        flag::Counters counters{flags};
+        ArgsT args{"program", "--count=1", "serve", "--port=2"};
+        REQUIRE(!flags.Parse(static_cast<int>(args.size()), args.data(), recorder));
+        REQUIRE(recorder.flags == std::vector<std::string>{"count=1", "port=2"});
+        REQUIRE(!flags.Parse(static_cast<int>(args.size()), args.data(), counters));
+        REQUIRE(counters.Hits("count") == 1);
+    }
+}
+
+TEST_CASE("Snapshots") {
+    struct Config {
+        int port = 0;
+        bool verbose = false;
+        std::string name{};
+        std::string_view mode{};
+        std::optional<double> ratio{};
+        std::vector<int> ids{};
+        flag::Lazy<int> depth{1};
+        flag::Live<int> batch{8};
+        std::atomic<std::int64_t> limit{0};
+
+        void Bind(flag::FlagSet &flags) {
+            flags.Var(port, "port", "The port");
+            flags.Var(verbose, "verbose", "Verbose output");
+            flags.Var(name, "name", "A name");
+            flags.Var(mode, "mode", "A mode");
+            flags.Var(ratio, "ratio", "A ratio");
+            flags.Var(ids, "id", "Ids");
+            flags.Var(depth, "depth", "A depth");
+            flags.Var(batch, "batch", "A batch size");
+            flags.Var(limit, "limit", "A limit");
+        }
+    };
+
+    Config saved{};
+    flag::FlagSet savedFlags{};
+    saved.Bind(savedFlags);
+    std::vector<const char *> args{"test", "-port=8080", "-verbose", "-name=server", "-mode=fast",
+                                   "-id=1", "-id=2", "-depth=3", "-batch=16", "-limit=-5"};
+    REQUIRE(!savedFlags.Parse(static_cast<int>(args.size()), args.data()));
+    auto snapshot = savedFlags.SaveSnapshot();
+
+    Config loaded{};
+    flag::FlagSet loadedFlags{};
+    loaded.Bind(loadedFlags);
+
+    SECTION("round trip") {
+        auto error = loadedFlags.LoadSnapshot(snapshot);
+        CAPTURE(error ? error->What() : std::string{});
+        REQUIRE(!error);
+        REQUIRE(loaded.port == 8080);
+        REQUIRE(loaded.verbose);
+        REQUIRE(loaded.name == "server");
+        REQUIRE(loaded.mode == "fast");
+        REQUIRE(!loaded.ratio);
+        REQUIRE(loaded.ids == std::vector<int>{1, 2});
+        REQUIRE(loaded.depth.Get() == 3);
+        REQUIRE(loaded.batch.Get() == 16);
+        REQUIRE(loaded.limit.load() == -5);
+        REQUIRE(loadedFlags.SourceOf("port") == flag::Source::CommandLine);
+        REQUIRE(loadedFlags.SourceOf("ratio") == flag::Source::Default);
+        REQUIRE(loadedFlags.SaveSnapshot() == snapshot);
+    }
+
+    SECTION("unset lazy") {
+        Config unset{};
+        flag::FlagSet unsetFlags{};
+        unset.Bind(unsetFlags);
+        auto unsetSnapshot = unsetFlags.SaveSnapshot();
+        std::vector<const char *> depthArgs{"test", "-depth=42"};
+        REQUIRE(!loadedFlags.Parse(static_cast<int>(depthArgs.size()), depthArgs.data()));
+        REQUIRE(loaded.depth.Get() == 42);
+        REQUIRE(!loadedFlags.LoadSnapshot(unsetSnapshot));
+        REQUIRE(!loaded.depth.IsSet());
+        REQUIRE(loaded.depth.Get() == 1);
+        REQUIRE(!loaded.depth.Resolve());
+        REQUIRE(!loadedFlags.LoadSnapshot(snapshot));
+        REQUIRE(loaded.depth.Get() == 3);
+    }
+
+    SECTION("different flags") {
+        int extra = 0;
+        loadedFlags.Var(extra, "extra", "An extra flag");
+        auto error = loadedFlags.LoadSnapshot(snapshot);
+        REQUIRE(error);
+        REQUIRE(error->Type() == flag::Error::EType::BadSnapshot);
+        REQUIRE(error->What() == "Bad snapshot: saved from different flags");
+        REQUIRE(loaded.port == 0);
+    }
+
+    SECTION("different types") {
+        flag::FlagSet other{};
+        long port = 0;
+        other.Var(port, "port", "The port");
+        flag::FlagSet single{};
+        int intPort = 4;
+        single.Var(intPort, "port", "The port");
+        REQUIRE(other.LoadSnapshot(single.SaveSnapshot()));
+        REQUIRE(port == 0);
+    }
+
+    SECTION("truncated") {
+        for (auto size: {std::size_t{0}, std::size_t{8}, snapshot.size() - 1}) {
+            auto error = loadedFlags.LoadSnapshot(std::string_view(snapshot).substr(0, size));
+            REQUIRE(error);
+            REQUIRE(error->Type() == flag::Error::EType::BadSnapshot);
+        }
+        REQUIRE(loaded.port == 0);
+        REQUIRE(loaded.name.empty());
+    }
+
+    SECTION("file") {
+        auto path = writeTempFile("flagcxx_snapshot.bin", snapshot);
+        snapshot.assign(snapshot.size(), '\0');
+        auto error = loadedFlags.LoadSnapshotFile(path);
+        CAPTURE(error ? error->What() : std::string{});
+        REQUIRE(!error);
+        REQUIRE(loaded.mode == "fast");
+        REQUIRE(loaded.name == "server");
+    }
+
+    SECTION("registered flags") {
+        auto registered = flag::Registered().SaveSnapshot();
+        auto port = FLAG_registered_port;
+        FLAG_registered_port = port + 1;
+        REQUIRE(!flag::Registered().LoadSnapshot(registered));
+        REQUIRE(FLAG_registered_port == port);
+    }
+}
+
+TEST_CASE("Usage") {
+    flag::FlagSet flags{};
+    int port = 0;
+    bool verbose = false;
+    std::vector<std::string> tags{};
+    std::optional<double> ratio{};
+    flags.Var(port, "port", "The port to listen on, which must not be in use by any other process on this host");
+    flags.Var(verbose, "verbose", "Verbose output");
+    flags.Var(tags, "tag", "Tags, \"quoted\"");
+    flags.Var(ratio, "ratio", "");
+    flags.Subcommand("serve", "Serves requests", [](flag::FlagSet &) {});
+
+    std::vector<const char *> args{"test", "-help"};
+    auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+    REQUIRE(error);
+    REQUIRE(error->Type() == flag::Error::EType::Help);
+
+    SECTION("text") {
+        REQUIRE(flags.Usage() == "Flags:\n"
+                                 "  -port <int>       The port to listen on, which must not be in use by any other\n"
+                                 "                    process on this host\n"
+                                 "  -ratio <float>\n"
+                                 "  -tag <string>...  Tags, \"quoted\"\n"
+                                 "  -verbose          Verbose output\n"
+                                 "\n"
+                                 "Commands:\n"
+                                 "  serve             Serves requests\n");
+    }
+
+    SECTION("json") {
+        REQUIRE(flags.Usage(flag::UsageFormat::Json) ==
+                "{\"flags\":["
+                "{\"name\":\"port\",\"type\":\"int\",\"repeated\":false,"
+                "\"usage\":\"The port to listen on, which must not be in use by any other process on this host\"},"
+                "{\"name\":\"ratio\",\"type\":\"float\",\"repeated\":false,\"usage\":\"\"},"
+                "{\"name\":\"tag\",\"type\":\"string\",\"repeated\":true,\"usage\":\"Tags, \\\"quoted\\\"\"},"
+                "{\"name\":\"verbose\",\"type\":\"bool\",\"repeated\":false,\"usage\":\"Verbose output\"}],"
+                "\"commands\":[{\"name\":\"serve\",\"usage\":\"Serves requests\"}]}\n");
+    }
+
+    SECTION("cached until flags change") {
+        auto first = flags.Usage();
+        REQUIRE(flags.Usage().data() == first.data());
+        int count = 0;
+        flags.Var(count, "count", "A count");
+        REQUIRE(flags.Usage().find("  -count <int>") != std::string_view::npos);
+    }
+
+    SECTION("sinks and file descriptors") {
+        std::string sunk{};
+        flags.PrintUsage([&sunk](std::string_view text) { sunk.append(text); });
+        REQUIRE(sunk == flags.Usage());
+
+        auto path = writeTempFile("flagcxx_usage.txt", "");
+        auto file = std::fopen(path.c_str(), "wb");
+        REQUIRE(file != nullptr);
+        REQUIRE(flags.PrintUsage(fileno(file), flag::UsageFormat::Json));
+        std::fclose(file);
+        std::ifstream in(path, std::ios::binary);
+        std::string written((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        REQUIRE(written == flags.Usage(flag::UsageFormat::Json));
+        REQUIRE(!flags.PrintUsage(-1));
+    }
+}
+
+namespace {
+    std::size_t editDistance(std::string_view a, std::string_view b) {
+        std::vector<std::size_t> row(b.size() + 1);
+        for (std::size_t j = 0; j <= b.size(); ++j) {
+            row[j] = j;
+        }
+        for (std::size_t i = 1; i <= a.size(); ++i) {
+            auto diagonal = row[0];
+            row[0] = i;
+            for (std::size_t j = 1; j <= b.size(); ++j) {
+                auto above = row[j];
+                row[j] = std::min({row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] == b[j - 1] ? 0 : 1)});
+                diagonal = above;
+            }
+        }
+        return row[b.size()];
+    }
+}// namespace
+
+TEST_CASE("Suggestions and prefixes") {
+    flag::FlagSet flags{};
+    bool verbose = false;
+    bool version = false;
+    int port = 0;
+    int portRange = 0;
+    std::string name{};
+    flags.Var(verbose, "verbose", "Verbose output");
+    flags.Var(version, "version", "Print the version");
+    flags.Var(port, "port", "The port");
+    flags.Var(portRange, "port-range", "The port range");
+    flags.Var(name, "name", "A name");
+
+    SECTION("undefined flags carry suggestions") {
+        ArgsT args{"program", "--verbos"};
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(error);
+        REQUIRE(error->Type() == flag::Error::EType::UndefinedFlag);
+        REQUIRE(error->Suggestion() == "verbose");
+        REQUIRE(error->What() == "Flag provided but not defined: verbos, did you mean verbose?");
+
+        REQUIRE(flags.Suggest("nmae") == "name");
+        REQUIRE(flags.Suggest("prot") == "port");
+        REQUIRE(flags.Suggest("colour").empty());
+        REQUIRE(flags.Suggest("x").empty());
+    }
+
+    SECTION("far misspellings have no suggestion") {
+        ArgsT args{"program", "--threads=4"};
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(error);
+        REQUIRE(error->Suggestion().empty());
+        REQUIRE(error->What() == "Flag provided but not defined: threads");
+    }
+
+    SECTION("config files") {
+        auto path = writeTempFile("flagcxx_suggest.ini", "prot = 80\n");
+        auto error = flags.ParseFile(path);
+        REQUIRE(error);
+        REQUIRE(error->Suggestion() == "port");
+    }
+
+    SECTION("prefixes are off by default") {
+        ArgsT args{"program", "--verb"};
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(error);
+        REQUIRE(error->Type() == flag::Error::EType::UndefinedFlag);
+        REQUIRE(!verbose);
+    }
+
+    SECTION("unambiguous prefixes") {
+        flags.AllowPrefixes(true);
+        ArgsT args{"program", "--verb", "-na", "x", "-port=1", "-port-r=2", "--versio"};
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        CAPTURE(error ? error->What() : std::string{});
+        REQUIRE(!error);
+        REQUIRE(verbose);
+        REQUIRE(version);
+        REQUIRE(name == "x");
+        REQUIRE(port == 1);
+        REQUIRE(portRange == 2);
+    }
+
+    SECTION("ambiguous prefixes") {
+        flags.AllowPrefixes(true);
+        for (auto arg: {"--ver", "-por=1", "-p=1"}) {
+            ArgsT args{"program", arg};
+            auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+            REQUIRE(error);
+            REQUIRE(error->Type() == flag::Error::EType::UndefinedFlag);
+        }
+    }
+
+    SECTION("help is not a prefix") {
+        flags.AllowPrefixes(true);
+        std::string host{};
+        std::string helper{};
+        flags.Var(host, "host", "The host");
+        flags.Var(helper, "helper", "A helper");
+        for (auto arg: {"-h", "--help"}) {
+            ArgsT args{"program", arg, "x"};
+            auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+            REQUIRE(error);
+            REQUIRE(error->Type() == flag::Error::EType::Help);
+        }
+        REQUIRE(host.empty());
+        REQUIRE(helper.empty());
+    }
+
+    SECTION("flags added later are indexed") {
+        REQUIRE(flags.Suggest("thread").empty());
+        int threads = 0;
+        flags.Var(threads, "threads", "Worker threads");
+        REQUIRE(flags.Suggest("thread") == "threads");
+    }
+
+    SECTION("matches a full search") {
+        flag::FlagSet many{};
+        std::vector<std::string> names{};
+        for (int i = 0; i < 500; ++i) {
+            names.push_back("opt" + std::to_string(i * 37 % 1000) + (i % 3 == 0 ? "-x" : ""));
+        }
+        std::vector<int> values(names.size());
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            many.Var(values[i], names[i], "A flag");
+        }
+        for (std::string query: {"opt12", "opt1234", "op", "ot37", "opt999-x", "opt5-y", "zzzz"}) {
+            std::string_view best{};
+            std::size_t bestDistance = query.size() <= 3 ? 2 : 3;
+            for (const auto &candidate: names) {
+                auto distance = editDistance(query, candidate);
+                if (distance < bestDistance || (distance == bestDistance && candidate < best)) {
+                    best = candidate;
+                    bestDistance = distance;
+                }
+            }
+            CAPTURE(query);
+            REQUIRE(many.Suggest(query) == best);
+        }
+    }
+}
+
+namespace {
+    struct ServerConfig {
+        int threads = 4;
+        bool verbose = false;
+        std::string name{"server"};
+        std::optional<double> ratio{};
+        std::vector<int> ports{};
+        flag::Lazy<long> limit{10};
+    };
+
+    const std::array<flag::Field<ServerConfig>, 3> serverFields{{
+            {&ServerConfig::threads, "threads", "Worker threads"},
+            {&ServerConfig::verbose, "verbose", "Verbose output"},
+            {&ServerConfig::name, "name", "The server name"},
+    }};
+}// namespace
+
+TEST_CASE("Struct binding") {
+    SECTION("initializer list") {
+        ServerConfig config{};
+        flag::FlagSet flags{};
+        flag::Bind(flags, config,
+                   {{&ServerConfig::threads, "threads", "Worker threads"},
+                    {&ServerConfig::verbose, "verbose", "Verbose output"},
+                    {&ServerConfig::name, "name", "The server name"},
+                    {&ServerConfig::ratio, "ratio", "A ratio"},
+                    {&ServerConfig::ports, "port", "Ports to listen on"},
+                    {&ServerConfig::limit, "limit", "A limit"}});
+        ArgsT args{"program", "-threads=16", "-verbose", "-name", "api", "-ratio=0.5", "-port=80,443", "-limit=7"};
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        CAPTURE(error ? error->What() : std::string{});
+        REQUIRE(!error);
+        REQUIRE(config.threads == 16);
+        REQUIRE(config.verbose);
+        REQUIRE(config.name == "api");
+        REQUIRE(config.ratio == 0.5);
+        REQUIRE(config.ports == std::vector<int>{80, 443});
+        REQUIRE(config.limit.Get() == 7);
+        REQUIRE(flags.Usage().find("  -port <int>...") != std::string_view::npos);
+    }
+
+    SECTION("shared fields") {
+        ServerConfig first{};
+        ServerConfig second{};
+        flag::FlagSet firstFlags{};
+        flag::FlagSet secondFlags{};
+        flag::Bind(firstFlags, first, serverFields);
+        flag::Bind(secondFlags, second, serverFields);
+        ArgsT firstArgs{"program", "-threads=1", "-name=one"};
+        ArgsT secondArgs{"program", "-threads=2", "-verbose"};
+        REQUIRE(!firstFlags.Parse(static_cast<int>(firstArgs.size()), firstArgs.data()));
+        REQUIRE(!secondFlags.Parse(static_cast<int>(secondArgs.size()), secondArgs.data()));
+        REQUIRE(first.threads == 1);
+        REQUIRE(first.name == "one");
+        REQUIRE(!first.verbose);
+        REQUIRE(second.threads == 2);
+        REQUIRE(second.name == "server");
+        REQUIRE(second.verbose);
+        REQUIRE(serverFields[0].Name() == "threads");
+        REQUIRE(serverFields[2].Usage() == "The server name");
+    }
+}
+
+namespace {
+    enum class Mode { Fast, Safe, Paranoid };
+
+    constexpr auto modes = flag::MakeEnum<Mode>({{"safe", Mode::Safe}, {"fast", Mode::Fast}, {"paranoid", Mode::Paranoid}});
+    static_assert(modes.Find("fast") == Mode::Fast);
+    static_assert(!modes.Find("turbo"));
+    static_assert(flag::Pattern("[a-z]*-v[0-9]").Matches("api-v2"));
+    static_assert(!flag::Pattern("[a-z]*-v[0-9]").Matches("api-v"));
+
+    // A user-defined constraint: any type with a Check method.
+    struct Even {
+        std::optional<flag::FlagError> Check(int value) const {
+            if (value % 2 == 0) {
+                return {};
+            }
+            return flag::FlagError::Static("number must be even");
+        }
+    };
+
+    // A constraint that formats its message into a local buffer, which the error must copy.
+    struct Below {
+        int limit;
+        std::optional<flag::FlagError> Check(int value) const {
+            if (value < limit) {
+                return {};
+            }
+            char buffer[32]{};
+            std::snprintf(buffer, sizeof(buffer), "number must be below %d", limit);
+            return flag::FlagError(buffer);
+        }
+    };
+}// namespace
+
+TEST_CASE("Constraints") {
+    flag::FlagSet flags{};
+
+    SECTION("ranges") {
+        int threads{4};
+        std::size_t workers{1};
+        double ratio{0.5};
+        std::optional<int> level{};
+        flags.Var(threads, "threads", "Worker threads", flag::Range(1, 256));
+        flags.Var(workers, "workers", "Workers", flag::Range(1, 8));
+        flags.Var(ratio, "ratio", "A ratio", flag::Range(0.0, 1.0));
+        flags.Var(level, "level", "A level", flag::Range(-3, 3));
+
+        ArgsT ok{"program", "-threads=256", "-workers", "8", "-ratio=0", "-level=-3"};
+        parse(flags, ok);
+        REQUIRE(threads == 256);
+        REQUIRE(workers == 8);
+        REQUIRE(ratio == 0.0);
+        REQUIRE(level == -3);
+
+        ArgsT tooMany{"program", "-threads=257"};
+        auto error = parseError(flags, tooMany);
+        REQUIRE(error.Type() == flag::Error::EType::BadValue);
+        REQUIRE(error.Name() == "threads");
+        REQUIRE(error.What() == "Bad value 257 for flag threads: number must be between 1 and 256");
+        REQUIRE(threads == 256);
+
+        ArgsT fraction{"program", "-ratio=1.5"};
+        REQUIRE(parseError(flags, fraction).What() == "Bad value 1.5 for flag ratio: number must be between 0 and 1");
+        REQUIRE(ratio == 0.0);
+        for (auto arg: {"-ratio=nan", "-ratio=-nan", "-ratio=inf"}) {
+            ArgsT special{"program", arg};
+            REQUIRE(parseError(flags, special).Type() == flag::Error::EType::BadValue);
+            REQUIRE(ratio == 0.0);
+        }
+
+        ArgsT none{"program", "-workers=0"};
+        REQUIRE(parseError(flags, none).What() == "Bad value 0 for flag workers: number must be between 1 and 8");
+        ArgsT optional{"program", "-level=4"};
+        REQUIRE(parseError(flags, optional).What() == "Bad value 4 for flag level: number must be between -3 and 3");
+        REQUIRE(level == -3);
+    }
+
+    SECTION("list elements") {
+        std::vector<int> ports{};
+        flags.Var(ports, "port", "Ports", flag::Range(1, 65535));
+        ArgsT args{"program", "-port=80,443", "-port=8080,70000"};
+        auto error = parseError(flags, args);
+        REQUIRE(error.What() == "Bad value 8080,70000 for flag port: number must be between 1 and 65535");
+        REQUIRE(ports == std::vector<int>{80, 443});
+    }
+
+    SECTION("enums") {
+        Mode mode{Mode::Safe};
+        flags.Var(mode, "mode", "The mode", modes);
+        ArgsT fast{"program", "-mode", "fast"};
+        parse(flags, fast);
+        REQUIRE(mode == Mode::Fast);
+
+        ArgsT turbo{"program", "-mode=turbo"};
+        auto error = parseError(flags, turbo);
+        REQUIRE(error.Type() == flag::Error::EType::BadValue);
+        REQUIRE(error.What() == "Bad value turbo for flag mode: value must be one of fast, paranoid, safe");
+        REQUIRE(mode == Mode::Fast);
+        REQUIRE(flags.Usage() == "Flags:\n  -mode <enum>  The mode\n");
+
+        auto snapshot = flags.SaveSnapshot();
+        mode = Mode::Paranoid;
+        REQUIRE(!flags.LoadSnapshot(snapshot));
+        REQUIRE(mode == Mode::Fast);
+    }
+
+    SECTION("patterns") {
+        std::string name{};
+        std::string_view tag{};
+        flags.Var(name, "name", "A name", flag::Pattern("[a-z]*"));
+        flags.Var(tag, "tag", "A tag", flag::Pattern("v[0-9]*.[0-9]"));
+        ArgsT ok{"program", "-name=api", "-tag=v12.3"};
+        parse(flags, ok);
+        REQUIRE(name == "api");
+        REQUIRE(tag == "v12.3");
+
+        ArgsT bad{"program", "-name=API"};
+        REQUIRE(parseError(flags, bad).What() == "Bad value API for flag name: value does not match [a-z]*");
+        REQUIRE(name == "api");
+
+        REQUIRE(flag::Pattern("*.txt").Matches("notes.txt"));
+        REQUIRE(!flag::Pattern("*.txt").Matches("notes.txt.gz"));
+        REQUIRE(flag::Pattern("a*b*c").Matches("axxbyybzc"));
+        REQUIRE(!flag::Pattern("a*b*c").Matches("axxbyy"));
+        REQUIRE(flag::Pattern("h?llo").Matches("hallo"));
+        REQUIRE(!flag::Pattern("h?llo").Matches("hllo"));
+        REQUIRE(flag::Pattern("[!0-9]x").Matches("ax"));
+        REQUIRE(!flag::Pattern("[!0-9]x").Matches("5x"));
+        REQUIRE(flag::Pattern("[]a-]").Matches("]"));
+        REQUIRE(flag::Pattern("[]a-]").Matches("-"));
+        REQUIRE(!flag::Pattern("[]a-]").Matches("b"));
+        REQUIRE(flag::Pattern("\\*").Matches("*"));
+        REQUIRE(!flag::Pattern("\\*").Matches("x"));
+        REQUIRE(flag::Pattern("").Matches(""));
+        REQUIRE(flag::Pattern("**").Matches(""));
+    }
+
+    SECTION("custom constraints") {
+        int count{0};
+        flags.Var(count, "count", "An even count", Even{});
+        ArgsT ok{"program", "-count=4"};
+        parse(flags, ok);
+        REQUIRE(count == 4);
+        ArgsT odd{"program", "-count=5"};
+        REQUIRE(parseError(flags, odd).What() == "Bad value 5 for flag count: number must be even");
+        REQUIRE(count == 4);
+
+        int depth{0};
+        flags.Var(depth, "depth", "A shallow depth", Below{10});
+        ArgsT deep{"program", "-depth=12"};
+        REQUIRE(parseError(flags, deep).What() == "Bad value 12 for flag depth: number must be below 10");
+
+        static constexpr char fixed[] = "fixed message";
+        REQUIRE(flag::FlagError::Static(fixed).What().data() == fixed);
+    }
+
+    SECTION("checking does not allocate") {
+        int threads{1};
+        std::string name{};
+        Mode mode{};
+        flags.Var(threads, "threads", "Worker threads", flag::Range(1, 256));
+        flags.Var(name, "name", "A name", flag::Pattern("[a-z]*"));
+        flags.Var(mode, "mode", "The mode", modes);
+        ArgsT args{"program", "-threads=16", "-name=api", "-mode=paranoid"};
+        auto before = allocations.load();
+        auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+        REQUIRE(allocations - before == 0);
+        REQUIRE(!error);
+        REQUIRE(threads == 16);
+        REQUIRE(mode == Mode::Paranoid);
+    }
+}
+
+#if FLAGCXX_HAS_PMR
+namespace {
+    // Counts the allocations made from an upstream resource.
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        explicit CountingResource(std::pmr::memory_resource *upstream) : upstream(upstream) {}
+
+        std::size_t allocated{0};
+        std::size_t outstanding{0};
+
+    private:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+            ++allocated;
+            ++outstanding;
+            return upstream->allocate(bytes, alignment);
+        }
+        void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override {
+            --outstanding;
+            upstream->deallocate(p, bytes, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+        std::pmr::memory_resource *upstream;
+    };
+}// namespace
+
+TEST_CASE("Memory resources") {
+    alignas(std::max_align_t) static std::array<std::byte, 1 << 16> buffer{};
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+    CountingResource counting(&arena);
+    auto path = writeTempFile("flagcxx_pmr_response_file.rsp", "-count=3 -tag=from-a-response-file");
+
+    int count = 0;
+    int depth = 0;
+    {
+        std::pmr::string name(&counting);
+        std::pmr::vector<std::pmr::string> tags(&counting);
+        {
+            std::string response = "@" + path;
+            ArgsT args{"program", "-name=a-name-too-long-for-small-strings", response.c_str(),
+                       "-tag=another-value-too-long-for-small-strings,x", "run", "-depth=2"};
+            auto before = allocations.load();
+            flag::FlagSet flags(&counting);
+            flags.Var(count, "count", "A count");
+            flags.Var(name, "name", "A name");
+            flags.Var(tags, "tag", "Tags");
+            flags.Subcommand("run", "Runs", [&depth](flag::FlagSet &child) { child.Var(depth, "depth", "A depth"); });
+            auto error = flags.Parse(static_cast<int>(args.size()), args.data());
+            auto usage = flags.Usage();
+            auto suggestion = flags.Suggest("cont");
+            auto global = allocations - before;
+
+            CAPTURE(error ? error->What() : std::string{});
+            REQUIRE(!error);
+            REQUIRE(global == 0);
+            REQUIRE(flags.Resource() == &counting);
+            REQUIRE(flags.Child()->Resource() == &counting);
+            REQUIRE(usage.find("  -tag <string>...") != std::string_view::npos);
+            REQUIRE(suggestion == "count");
+        }
+        REQUIRE(count == 3);
+        REQUIRE(name == "a-name-too-long-for-small-strings");
+        REQUIRE(tags.size() == 3);
+        REQUIRE(tags[0] == "from-a-response-file");
+        REQUIRE(tags[1].get_allocator().resource() == &counting);
+        REQUIRE(depth == 2);
+    }
+    REQUIRE(counting.allocated > 0);
+    REQUIRE(counting.outstanding == 0);
+
+    SECTION("default FlagSets use the global heap") {
+        flag::FlagSet flags{};
+        auto before = allocations.load();
+        flags.Var(count, "count", "A count");
+        auto global = allocations - before;
+        REQUIRE(global > 0);
+    }
 }
+#endif